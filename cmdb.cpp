@@ -77,6 +77,70 @@ _____________________________________________________________________________
 
    20092011 -Serial port passed by pointer to prevent copy constructor error.
             -v0.86
+
+   18102026 -Replaced the linear stricmp() scan in cmdid_search() by a hashed,
+             case-folded name index, rebuilt by the constructor and replace().
+            -Replaced the linear scan in cmdid_index() by a cid hash table.
+            -Parameter patterns (cmd.parms) are compiled once by reindex(),
+             parse() no longer copies and strtok's them for every command.
+            -parse() tokenizes the command line in place into (offset, length)
+             spans, without copying or zeroing any buffers.
+            -Replaced strtol()/strtod() by range checked single pass conversion
+             kernels per parameter type. Unsigned types no longer go through
+             signed conversion and float/char errors are now reported.
+            -All output is written through a per-instance buffer (MAX_TX_LEN),
+             flushed at the prompt, when full, after scan() or by flush().
+            -printf() and friends format straight into the output buffer (no
+             more 1024/256 byte stack buffers) and are format checked by
+             the compiler (GCC/Clang).
+            -Added attach() for an interrupt driven receive buffer (MAX_RX_LEN),
+             poll() and scan(buf, len) to process input in bulk.
+            -scan(buf, len) copies and echoes runs of printable characters in one
+             step (SSE2 or word-at-a-time search for the next control character).
+            -Added CmdbTransport with CmdbSerial (RawSerial), CmdbFd (pipes, PTYs,
+             sockets), CmdbMemory and the CmdbPort<T> adapter.
+            -Moved the command table and its indexes into CmdbTable, which can be
+             shared (read-only) by any number of Cmdb instances.
+            -CmdbTable can be created on a const cmd array (kept in flash), the
+             predefined commands are then added from a const table if missing.
+            -Added CMDB_VALIDATE() and CmdbIndex (C++14) to check constexpr command
+             tables and build their (hash and displace) perfect hash at compile time.
+            -Added telnet() with ECHO, SGA and LINEMODE (RFC 1184) negotiation, line
+             mode clients edit locally and send whole lines. In telnet mode DEL
+             is a backspace and CR NUL/CR LF are a single CR.
+            -Overlong escape sequences are dropped instead of overflowing escbuf.
+            -Added async() and CmdbExecutor to run application commands outside
+             scan(), one at a time per instance, with the prompt printed by
+             execute() when the command completes.
+            -Added coroutines() (C++20), a coroutine command handler is resumed
+             by resume() between scan() calls and cancelled by Ctrl-C. poll()
+             holds the input meanwhile.
+            -A line may hold several commands separated by ';', dispatched in
+             order with a single prompt (and flush). stoponerror() skips the
+             rest of the line after a failed command and reports which failed.
+            -Replaced the single macro buffer by a store of named macros, compiled
+             (commands resolved, parameters converted) by Macro and dispatched
+             directly by Run, nested up to MAX_MACRO_DEPTH.
+            -cmd has an optional handler, called directly instead of the callback.
+             CMDB_CMD() (C++14) adapts handlers with typed parameters, checked
+             at compile time against the parameter patterns.
+            -String parameters are views into the command line, terminated in
+             place, instead of copies truncated at MAX_PARM_LEN (removed).
+             STRINGLEN() returns their length. STRINGPARM() returns a const
+             char *, as a default points into the shared CmdbTable.
+            -Added array parameters (%*d, %*f etc, last only) converted into the
+             buffer set by arraybuffer() and read by ARRAYPARM() as a CmdbSpan.
+            -MAX_CMD_LEN can be overridden, cmdndx is no longer a (signed) char.
+            -Added hex (%H) and base64 (%B) blob parameters, decoded in place by
+             table driven decoders and read by BLOBPARM() as a CmdbSpan.
+            -Added enum parameters (%{a|b|c}), resolved by a per pattern perfect
+             hash built by CmdbTable into the position of the symbol (INTPARM()).
+             Help and the command dump list the symbols.
+            -Parameters may have a default (%i=10) and be left out when trailing,
+             or be named (baud=%i=9600) and given as key=value in any order.
+             Keys are resolved by a per command perfect hash, defaults are
+             converted once by CmdbTable.
+            -mbed.h is only included when __MBED__ is defined.
    -------- --------------------------------------------------------------
    TODO's
    10022011 -Tweak and Review Documentation.
@@ -92,99 +156,583 @@ _____________________________________________________________________________
 #include <stdarg.h>
 #include <ctype.h>
 #include <string.h>
+#include <stddef.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__unix__)
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#endif
 
 #include "cmdb.h"
-#include "mbed.h"
 
 //------------------------------------------------------------------------------
 
+/** Upper-cases a character (ASCII only, like toupper() in the "C" locale).
+ */
+static inline char fold(const char c) {
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+/** Powers of ten for to_float() and fmt_float() (all exact in a double).
+ */
+static const double pow10tbl[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/** Returns the length of the run of printable characters (' '..'~') at p.
+ *
+ * Checks 16 characters per step with SSE2, else a machine word per step.
+ */
+static unsigned int printable_run(const char *p, unsigned int len) {
+    unsigned int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i lo = _mm_set1_epi8(' ' - 1);
+    const __m128i hi = _mm_set1_epi8('~' + 1);
+
+    //Signed compares, so characters >= 0x80 fail the lower bound.
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        int mask  = _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi)));
+
+        if (mask != 0xFFFF) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#else
+    const unsigned long ones = ~0UL / 255;
+    const unsigned long high = ones * 0x80;
+
+    for (; i + sizeof(unsigned long) <= len; i += sizeof(unsigned long)) {
+        unsigned long w;
+
+        memcpy(&w, p + i, sizeof(w));
+
+        //High bit set in a byte < ' ' (borrow), >= 0x80 (w) or == DEL (carry out of the low 7 bits).
+        unsigned long ctl = ((w - ones * ' ') | w | ((w & ~high) + ones)) & high;
+
+        if (ctl) {
+            break;                                  //Locate it bytewise.
+        }
+    }
+#endif
+
+    while (i < len && p[i] >= ' ' && p[i] <= '~') {
+        i++;
+    }
+
+    return i;
+}
+
+/** Telnet commands (RFC 854) and options (RFC 857, 858 and 1184).
+ */
+enum telnet {
+    TN_SE   = 240,
+    TN_NOP  = 241,
+    TN_IP   = 244,                                  // Interrupt Process.
+    TN_EC   = 247,                                  // Erase Character.
+    TN_EL   = 248,                                  // Erase Line.
+    TN_SB   = 250,
+    TN_WILL = 251,
+    TN_WONT = 252,
+    TN_DO   = 253,
+    TN_DONT = 254,
+    TN_IAC  = 255,
+
+    TO_ECHO     = 1,
+    TO_SGA      = 3,
+    TO_LINEMODE = 34,
+
+    LM_MODE        = 1,                             // LINEMODE suboptions.
+    LM_FORWARDMASK = 2,
+
+    LM_MODE_EDIT   = 1,
+    LM_MODE_ACK    = 4
+};
+
+//------------------------------------------------------------------------------
+
+#if defined(__MBED__)
 Cmdb::Cmdb(RawSerial *_serial, std::vector<cmd>& _cmds, void (*_callback)(Cmdb&,int)) :
-        serial(_serial), cmds(_cmds) {
+        serial(_serial), transport(&serial), owntable(new CmdbTable(_cmds)) {
+    table = owntable;
+
+    create(_callback);
+}
+
+Cmdb::Cmdb(RawSerial *_serial, const CmdbTable& _table, void (*_callback)(Cmdb&,int)) :
+        serial(_serial), transport(&serial), table(&_table), owntable(NULL) {
+    create(_callback);
+}
+#endif
+
+Cmdb::Cmdb(CmdbTransport *_transport, std::vector<cmd>& _cmds, void (*_callback)(Cmdb&,int)) :
+        transport(_transport), owntable(new CmdbTable(_cmds)) {
+    table = owntable;
+
+    create(_callback);
+}
+
+Cmdb::Cmdb(CmdbTransport *_transport, const CmdbTable& _table, void (*_callback)(Cmdb&,int)) :
+        transport(_transport), table(&_table), owntable(NULL) {
+    create(_callback);
+}
+
+Cmdb::~Cmdb() {
+#if defined(CMDB_COROUTINES)
+    if (cotask) {
+        std::coroutine_handle<>::from_address(cotask).destroy();
+    }
+#endif
+
+    delete owntable;
+}
+
+void  Cmdb::create(void (*_callback)(Cmdb&,int)) {
     echo = true;
     bold = true;
 
-    NoComment = NULL;
-    DefComPos = 72;
-
     subsystem = -1;
 
     user_callback = _callback;
 
+    executor    = NULL;
+    done        = NULL;
+    donecontext = NULL;
+    pending     = false;
+
+    pendinghandler = NULL;
+
+    co_callback = NULL;
+    cotask      = NULL;
+
+    batchpos  = -1;
+    batchno   = 0;
+    batchstop = false;
+
+    macro_used  = 0;
+    macro_depth = 0;
+
+    arraybuf  = NULL;
+    arraysize = 0;
+
+    cmdndx    = 0;
+
+    rxhead     = 0;
+    rxtail     = 0;
+    rxdropped  = 0;
+    rxpeak     = 0;
+    rxattached = false;
+
+    tnstate    = TNS_OFF;
+    tnlinemode = false;
+    tnecho     = false;
+    tnsga      = false;
+    tnpeersga  = false;
+
+    txndx     = 0;
+    txhold    = 0;
+    txflushes = 0;
+
     init(true);
 }
 
-const char* Cmdb::NoComment;
+const char* Cmdb::NoComment = NULL;
 
-int Cmdb::DefComPos;
+int Cmdb::DefComPos = 72;
 
 //------------------------------------------------------------------------------
-// Public Stuff.
+// Transports.
 //------------------------------------------------------------------------------
 
-bool  Cmdb::macro_hasnext() {
-    return macro_ptr!=-1 && macro_ptr<MAX_CMD_LEN && macro_buf[macro_ptr];
+#if defined(__MBED__)
+int   CmdbSerial::readable() {
+    return serial->readable();
 }
 
-char Cmdb::macro_next() {
-    char ch = macro_buf[macro_ptr++];
+int   CmdbSerial::read(char *buf, unsigned int len) {
+    unsigned int cnt = 0;
 
-    if (macro_ptr==MAX_CMD_LEN) {
-        macro_reset();
+    //Block for the first character only (like getc()).
+    do {
+        buf[cnt++] = serial->getc();
+    } while (cnt < len && serial->readable());
+
+    return cnt;
+}
+
+int   CmdbSerial::write(const char *buf, unsigned int len) {
+    char run[65];
+    unsigned int i = 0;
+
+    //puts() needs a NULL-terminated string, so copy runs and write embedded NULL's separately.
+    while (i < len) {
+        unsigned int n = 0;
+
+        if (buf[i] == '\0') {
+            serial->putc('\0');
+            i++;
+            continue;
+        }
+
+        while (i < len && buf[i] != '\0' && n < sizeof(run) - 1) {
+            run[n++] = buf[i++];
+        }
+        run[n] = '\0';
+
+        serial->puts(run);
     }
 
-    //Translate Special Characters Back
-    switch (ch) {
-        case '|':
-            return cr;
-        case '_':
-            return sp;
-        default:
-            return ch;
+    return len;
+}
+
+bool  CmdbSerial::attach(void (*_handler)(void *), void *_context) {
+    handler = _handler;
+    context = _context;
+
+    serial->attach(callback(this, &CmdbSerial::irq), SerialBase::RxIrq);
+
+    return true;
+}
+
+void  CmdbSerial::irq() {
+    handler(context);
+}
+#endif
+
+#if defined(__unix__)
+int   CmdbFd::readable() {
+    struct pollfd pfd;
+
+    pfd.fd      = in;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+
+    //End of input and errors count as readable, read() reports them.
+    return (!ended && ::poll(&pfd, 1, 0) > 0) ? 1 : 0;
+}
+
+int   CmdbFd::read(char *buf, unsigned int len) {
+    ssize_t n;
+
+    do {
+        n = ::read(in, buf, len);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        ended = true;
+    }
+
+    return (int)n;
+}
+
+int   CmdbFd::write(const char *buf, unsigned int len) {
+    unsigned int cnt = 0;
+
+    while (cnt < len) {
+        ssize_t n = ::write(out, buf + cnt, len - cnt);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        cnt += n;
     }
+
+    return cnt;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Public Stuff.
+//------------------------------------------------------------------------------
+
+bool  Cmdb::macro_hasnext() {
+    return false;
+}
+
+char Cmdb::macro_next() {
+    return '\0';
 }
 
 char  Cmdb::macro_peek() {
-    return macro_buf[macro_ptr];
+    return '\0';
 }
 
 void  Cmdb::macro_reset() {
-    macro_ptr         = -1;
-    macro_buf[0]     = '\0';
+    macro_used  = 0;
+    macro_depth = 0;
 }
 
 //------------------------------------------------------------------------------
 
 bool  Cmdb::hasnext() {
-    return serial->readable()==1;
+    if (rxattached) {
+        return rxhead != rxtail;
+    }
+
+    return transport->readable() > 0;
 }
 
 char  Cmdb::next() {
-    return serial->getc();
+    if (rxattached) {
+        char c = rxbuf[rxtail & (MAX_RX_LEN - 1)];
+
+        //Release the slot only after reading it.
+        rxtail = rxtail + 1;
+
+        return c;
+    }
+
+    char c = '\0';
+
+    transport->read(&c, 1);
+
+    return c;
+}
+
+bool  Cmdb::attach() {
+    //Set first, the interrupt may fire as soon as it is attached.
+    rxattached = true;
+
+    if (!transport->attach(&Cmdb::rx_thunk, this)) {
+        rxattached = false;
+    }
+
+    return rxattached;
+}
+
+void  Cmdb::rx_thunk(void *context) {
+    static_cast<Cmdb *>(context)->rx_irq();
+}
+
+void  Cmdb::rx_irq() {
+    while (transport->readable() > 0) {
+        unsigned int head = rxhead;
+        unsigned int used = head - rxtail;
+
+        if (used == MAX_RX_LEN) {
+            char c;
+
+            if (!rxattached) {
+                break;                                          //Called by poll(), leave the rest.
+            }
+
+            if (transport->read(&c, 1) <= 0) {
+                break;
+            }
+            rxdropped = rxdropped + 1;                          //Overrun.
+            continue;
+        }
+
+        //Read straight into the free (contiguous) part of the ring.
+        unsigned int ndx = head & (MAX_RX_LEN - 1);
+        unsigned int len = MAX_RX_LEN - used;
+
+        if (len > MAX_RX_LEN - ndx) {
+            len = MAX_RX_LEN - ndx;
+        }
+
+        int n = transport->read((char *)&rxbuf[ndx], len);
+
+        if (n <= 0) {
+            break;
+        }
+
+        //Publish the slots only after writing them.
+        rxhead = head + n;
+
+        if (used + n > rxpeak) {
+            rxpeak = used + n;
+        }
+    }
+}
+
+int   Cmdb::poll() {
+    int lines = 0;
+
+    if (!rxattached && !executor && !co_callback) {
+        char chunk[MAX_RX_LEN];
+
+        while (transport->readable() > 0) {
+            int n = transport->read(chunk, sizeof(chunk));
+
+            if (n <= 0) {
+                break;
+            }
+            lines += scan(chunk, n);
+        }
+
+        return lines;
+    }
+
+    for (;;) {
+        if (!rxattached) {
+            //Asynchronous or coroutine mode, buffer the input so it can be held while a command is busy.
+            rx_irq();
+        }
+
+        if (pending || rxhead == rxtail) {
+            break;
+        }
+
+        //Scan the contiguous part of the ring, the interrupt only writes free slots.
+        unsigned int tail = rxtail;
+        unsigned int ndx  = tail & (MAX_RX_LEN - 1);
+        unsigned int len  = rxhead - tail;
+
+        if (len > MAX_RX_LEN - ndx) {
+            len = MAX_RX_LEN - ndx;
+        }
+
+        if (cotask) {
+            //Hold the input while a coroutine command is suspended, up to a Ctrl-C (or telnet IP).
+            unsigned int  used = rxhead - tail;
+            unsigned int  k    = 0;
+            unsigned char prev = tnstate == TNS_IAC ? TN_IAC : 0;
+
+            for (; k < used; k++) {
+                unsigned char c = rxbuf[(tail + k) & (MAX_RX_LEN - 1)];
+
+                if (c == '\003' || (tnstate && prev == TN_IAC && c == TN_IP)) {
+                    break;
+                }
+                prev = (prev == TN_IAC && c == TN_IAC) ? 0 : c;
+            }
+
+            //Nothing to cancel, keep it for the next command unless the buffer is full.
+            if (k == used && used < MAX_RX_LEN) {
+                break;
+            }
+
+            //The input before a Ctrl-C is dropped by process() (see coroutines()).
+            if (k < used && len > k + 1) {
+                len = k + 1;
+            }
+        } else if (executor || co_callback) {
+            //A line at a time, the line may queue a command or start a coroutine one.
+            const char *cr = (const char *)memchr((const char *)&rxbuf[ndx], '\r', len);
+
+            if (cr) {
+                len = cr + 1 - (const char *)&rxbuf[ndx];
+            }
+        }
+
+        lines += scan((const char *)&rxbuf[ndx], len);
+
+        rxtail = tail + len;
+    }
+
+    return lines;
 }
 
 //------------------------------------------------------------------------------
 
 bool  Cmdb::scan(const char c) {
+    bool result;
+
+    //Buffer all output generated by this character and write it in one go.
+    txhold++;
+    result = tnstate ? tn_input(c) : process(c);
+    txhold--;
+
+    flush();
+
+    //Hand over a queued command only now, the executor's thread may run it at once.
+    if (pending) {
+        executor->submit(*this);
+    }
+
+    return result;
+}
+
+int   Cmdb::scan(const char *buf, unsigned int len) {
+    int lines = 0;
+
+    txhold++;
+    for (unsigned int i = 0; i < len && !pending; ) {
+        //Fast path: add a run of printable characters to the buffer and echo it in one go.
+        unsigned int n = (escndx || tnstate > TNS_DATA || cotask) ? 0 : printable_run(buf + i, len - i);
+
+        if (n) {
+            unsigned int room = MAX_CMD_LEN - cmdndx;
+            unsigned int fit  = n < room ? n : room;
+
+            memcpy(&cmdbuf[cmdndx], buf + i, fit);
+            cmdndx += fit;
+            cmdbuf [cmdndx] = '\0';                   // NULL-Terminate buffer
+
+            if (echo) {
+                txwrite(buf + i, fit);
+            }
+
+            for (unsigned int k = fit; k < n; k++) {
+                printch(bell);                      // Past buffer length?
+            }
+
+            i += n;
+            continue;
+        }
+
+        if (tnstate ? tn_input(buf[i++]) : process(buf[i++])) {
+            lines++;
+        }
+    }
+    txhold--;
+
+    flush();
+
+    if (pending) {
+        executor->submit(*this);
+    }
+
+    return lines;
+}
+
+bool  Cmdb::process(const char c) {
     int i;
 
     //See http://www.interfacebus.com/ASCII_Table.html
 
+    if (cotask) {                                   // Coroutine command running?
+        if (c == '\003') {                          // Ctrl-C
+            cancel();
+        } else {
+            rxdropped = rxdropped + 1;              // Typed ahead of a Ctrl-C.
+        }
+        return false;
+    }
+
     if (c == '\r') {                                // cr?
-        print(crlf);                           // Output it and ...
+        if (!tnlinemode) {
+            print(crlf);                            // Output it and ...
+        }
         if (cmdndx) {
             strncpy(lstbuf,cmdbuf,cmdndx);
             lstbuf[cmdndx]='\0';
 
-            cmd_dispatcher(cmdbuf);
+            //Commands separated by ';' are dispatched in order, with one prompt.
+            batchpos = 0;
+            batchno  = 0;
+            cmd_batch();
         }
         init(false);
-        prompt();
+        if (!pending && !cotask) {
+            prompt();                               // Else execute() or resume() does.
+        }
 
         return true;
     }
 
-    //TODO BACKSPACE NOT CORRECT FOR TELNET!
-
     if (c == '\b') {                                // Backspace
         if (cmdndx != 0) {
             print(bs);
@@ -250,6 +798,10 @@ bool  Cmdb::scan(const char c) {
             }
             escndx=0;
             escbuf [escndx]   = '\0';               // NULL-Terminate buffer
+        } else if (escndx == MAX_ESC_LEN) {         // Too long, drop it.
+            printch(bell);
+            escndx=0;
+            escbuf [escndx]   = '\0';               // NULL-Terminate buffer
         }
         return false;
     }
@@ -278,215 +830,2207 @@ bool  Cmdb::scan(const char c) {
     return false;
 }
 
+//------------------------------------------------------------------------------
+//----Telnet (RFC 854) with ECHO, SGA and LINEMODE (RFC 1184) negotiation.
 //------------------------------------------------------------------------------
 
-int   Cmdb::printf(const char *format, ...) {
-    int cnt;
-
-    va_list args;
-    char buf[1024];
-
-    memset(buf,'\0',sizeof(buf));
+void  Cmdb::telnet() {
+    static const char offer[] = {
+        (char)TN_IAC, (char)TN_WILL, TO_ECHO,
+        (char)TN_IAC, (char)TN_WILL, TO_SGA,
+        (char)TN_IAC, (char)TN_DO,   TO_LINEMODE
+    };
 
-    va_start(args, format);
-    cnt = vsnprintf(buf, sizeof(buf), format, args);
-    if (cnt==-1) {
-        //Error
-    }
-    va_end(args);
+    tnstate    = TNS_DATA;
+    tnlinemode = false;
+    tnecho     = true;
+    tnsga      = true;
+    tnpeersga  = false;
 
-    return print(buf);
+    tn_send(offer, sizeof(offer));
 }
 
-int   Cmdb::print(const char *msg) {
-    return serial->printf(msg);
-}
+bool  Cmdb::tn_input(const char c) {
+    unsigned char b = (unsigned char) c;
 
-int   Cmdb::println(const char *msg) {
-    return serial->printf("%s\r\n", msg);
-}
+    switch (tnstate) {
+        case TNS_CR:
+            tnstate = TNS_DATA;
+            if (b == '\0' || b == '\n') {            // CR NUL and CR LF are a single CR.
+                return false;
+            }
+            //Fall through.
+        case TNS_DATA:
+            if (b == TN_IAC) {
+                tnstate = TNS_IAC;
+                return false;
+            }
+            if (b == '\r') {
+                tnstate = TNS_CR;
+            }
+            return process(b == '\177' ? '\b' : c); // Telnet clients send DEL for backspace.
+
+        case TNS_IAC:
+            tnstate = TNS_DATA;
+            switch (b) {
+                case TN_IAC:
+                    return process(c);              // Escaped 0xFF.
+                case TN_WILL:
+                case TN_WONT:
+                case TN_DO:
+                case TN_DONT:
+                    tnverb  = b;
+                    tnstate = TNS_OPT;
+                    return false;
+                case TN_SB:
+                    tnsblen = 0;
+                    tnstate = TNS_SB;
+                    return false;
+                case TN_EC:
+                    return process('\b');
+                case TN_EL:
+                    return process('\177');         // Erases the line.
+                case TN_IP:
+                    return process('\003');
+                default:
+                    return false;                   // NOP, GA, AYT etc.
+            }
 
-int   Cmdb::printsection(const char *section) {
-    return printf("[%s]\r\n", section);
-}
+        case TNS_OPT:
+            tnstate = TNS_DATA;
+            tn_option(tnverb, b);
+            return false;
 
-int   Cmdb::printmsg(const char *msg) {
-    return printf("Msg=%s\r\n", msg);
-}
+        case TNS_SB:
+            if (b == TN_IAC) {
+                tnstate = TNS_SBIAC;
+            } else if (tnsblen < sizeof(tnsb)) {
+                tnsb[tnsblen++] = b;
+            }
+            return false;
 
-int   Cmdb::printerror(const char *errormsg) {
-    int a = printsection("Error");
-    return a==0?a:a+printmsg(errormsg);
+        case TNS_SBIAC:
+            if (b == TN_SE) {
+                tnstate = TNS_DATA;
+                tn_subneg();
+                return false;
+            }
+            tnstate = TNS_SB;
+            if (b == TN_IAC && tnsblen < sizeof(tnsb)) {
+                tnsb[tnsblen++] = b;                // Escaped 0xFF.
+            }
+            return false;
+    }
+
+    return process(c);
 }
 
-int   Cmdb::printerrorf(const char *format, ...) {
-    char buf[256];
+void  Cmdb::tn_option(unsigned char verb, unsigned char opt) {
+    char reply[3] = { (char)TN_IAC, 0, (char)opt };
+
+    //Only answer requests that change the state of an option, so negotiation cannot loop.
+    switch (verb) {
+        case TN_DO:
+            if (opt == TO_ECHO && !tnlinemode) {
+                if (tnecho) {
+                    return;
+                }
+                tnecho = true;
+                echo   = true;
+                reply[1] = (char)TN_WILL;
+            } else if (opt == TO_SGA) {
+                if (tnsga) {
+                    return;
+                }
+                tnsga = true;
+                reply[1] = (char)TN_WILL;
+            } else {
+                if (opt == TO_ECHO) {               // Line mode clients echo themselves.
+                    tnecho = false;
+                }
+                reply[1] = (char)TN_WONT;
+            }
+            break;
+
+        case TN_DONT:
+            if (opt == TO_ECHO) {
+                echo = false;
+                if (!tnecho) {
+                    return;
+                }
+                tnecho = false;
+            } else if (opt == TO_SGA && tnsga) {
+                tnsga = false;
+            } else {
+                return;
+            }
+            reply[1] = (char)TN_WONT;
+            break;
+
+        case TN_WILL:
+            if (opt == TO_LINEMODE) {
+                if (tnlinemode) {
+                    return;
+                }
+                static const char mode[] = {
+                    (char)TN_IAC, (char)TN_SB, TO_LINEMODE, LM_MODE, LM_MODE_EDIT, (char)TN_IAC, (char)TN_SE
+                };
+
+                tnlinemode = true;
+                echo       = false;
+                tn_send(mode, sizeof(mode));
+
+                if (!tnecho) {
+                    return;
+                }
+                tnecho   = false;
+                reply[1] = (char)TN_WONT;
+                reply[2] = TO_ECHO;
+            } else if (opt == TO_SGA) {
+                if (tnpeersga) {
+                    return;
+                }
+                tnpeersga = true;
+                reply[1]  = (char)TN_DO;
+            } else {
+                reply[1] = (char)TN_DONT;
+            }
+            break;
+
+        case TN_WONT:
+            if (opt == TO_LINEMODE && tnlinemode) {
+                //Back to character mode with our echo.
+                tnlinemode = false;
+                echo       = true;
+                if (tnecho) {
+                    return;
+                }
+                tnecho   = true;
+                reply[1] = (char)TN_WILL;
+                reply[2] = TO_ECHO;
+            } else if (opt == TO_SGA && tnpeersga) {
+                tnpeersga = false;
+                reply[1]  = (char)TN_DONT;
+            } else {
+                return;
+            }
+            break;
+    }
+
+    tn_send(reply, sizeof(reply));
+}
+
+void  Cmdb::tn_subneg() {
+    if (tnsblen < 3 || tnsb[0] != TO_LINEMODE) {
+        return;
+    }
+
+    //Refuse FORWARDMASK, lines are forwarded at CR. MODE acknowledgements and SLC need no answer.
+    if (tnsb[2] == LM_FORWARDMASK && (tnsb[1] == TN_DO || tnsb[1] == TN_WILL)) {
+        char reply[] = {
+            (char)TN_IAC, (char)TN_SB, TO_LINEMODE, 0, LM_FORWARDMASK, (char)TN_IAC, (char)TN_SE
+        };
+
+        reply[3] = (char)(tnsb[1] == TN_DO ? TN_WONT : TN_DONT);
+        tn_send(reply, sizeof(reply));
+    }
+}
+
+void  Cmdb::tn_send(const char *data, unsigned int len) {
+    flush();
+    txsend(data, len);
+}
+
+//------------------------------------------------------------------------------
+//----Asynchronous mode.
+//------------------------------------------------------------------------------
+
+void  Cmdb::async(CmdbExecutor *_executor, void (*_done)(Cmdb &, void *), void *_context) {
+    executor    = _executor;
+    done        = _done;
+    donecontext = _context;
+}
+
+void  Cmdb::execute() {
+    //Buffer the output like scan() does.
+    txhold++;
+    if (pendinghandler) {
+        (*pendinghandler)(*this);
+    } else {
+        (*user_callback)(*this, pendingcid);
+    }
+
+    //The rest of the line runs here too (pending is still set), in order.
+    cmd_batch();
+    txhold--;
+
+    prompt();
+
+    //Still busy, so a new command is not submitted before done returns.
+    if (done) {
+        (*done)(*this, donecontext);
+    }
+
+    pending = false;
+}
+
+//------------------------------------------------------------------------------
+//----Coroutine commands.
+//------------------------------------------------------------------------------
+
+bool  Cmdb::resume() {
+#if defined(CMDB_COROUTINES)
+    if (!cotask) {
+        return false;
+    }
+
+    std::coroutine_handle<> task = std::coroutine_handle<>::from_address(cotask);
+
+    //Buffer the output of a step like scan() does.
+    txhold++;
+    task.resume();
+
+    if (task.done()) {
+        task.destroy();
+        cotask = NULL;
+
+        //Continue the line, the next command may suspend again.
+        cmd_batch();
+        txhold--;
+
+        if (cotask) {
+            flush();
+
+            return true;
+        }
+
+        prompt();
+
+        return false;
+    }
+    txhold--;
+
+    flush();
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void  Cmdb::cancel() {
+#if defined(CMDB_COROUTINES)
+    std::coroutine_handle<>::from_address(cotask).destroy();
+#endif
+    cotask   = NULL;
+    batchpos = -1;                                  // Skip the rest of the line.
+
+    print("^C\r\n");
+    prompt();
+}
+
+//------------------------------------------------------------------------------
+
+int   Cmdb::printf(const char *format, ...) {
+    int cnt;
+
+    va_list args;
+
+    va_start(args, format);
+    cnt = vprintf(format, args);
+    va_end(args);
+
+    return cnt;
+}
+
+int   Cmdb::vprintf(const char *format, va_list args) {
+    int cnt = 0;
+
+    txhold++;
+
+    while (*format) {
+        //Copy literal text up to the next conversion in one go.
+        if (*format != '%') {
+            const char *run = format;
+
+            while (*format && *format != '%') {
+                format++;
+            }
+            cnt += txwrite(run, format - run);
+
+            continue;
+        }
+
+        format++;
+
+        //Flags.
+        unsigned char flags = 0;
+
+        for (;; format++) {
+            switch (*format) {
+                case '-' :
+                    flags |= FMT_LEFT;
+                    continue;
+                case '+' :
+                    flags |= FMT_PLUS;
+                    continue;
+                case ' ' :
+                    flags |= FMT_SPACE;
+                    continue;
+                case '#' :
+                    flags |= FMT_ALT;
+                    continue;
+                case '0' :
+                    flags |= FMT_ZERO;
+                    continue;
+            }
+            break;
+        }
+
+        //Width.
+        int width = 0;
+
+        if (*format == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                flags |= FMT_LEFT;
+                width = -width;
+            }
+            format++;
+        } else {
+            while (*format >= '0' && *format <= '9') {
+                width = width * 10 + (*format++ - '0');
+            }
+        }
+
+        //Precision.
+        int prec = -1;
+
+        if (*format == '.') {
+            format++;
+            prec = 0;
+
+            if (*format == '*') {
+                prec = va_arg(args, int);
+                format++;
+            } else {
+                while (*format >= '0' && *format <= '9') {
+                    prec = prec * 10 + (*format++ - '0');
+                }
+            }
+        }
+
+        //Length modifier.
+        char mod = '\0';
+
+        switch (*format) {
+            case 'h' :
+                mod = *format++;
+                if (*format == 'h') {
+                    mod = 'H';
+                    format++;
+                }
+                break;
+            case 'l' :
+                mod = *format++;
+                if (*format == 'l') {
+                    mod = 'L';
+                    format++;
+                }
+                break;
+            case 'j' :
+            case 'z' :
+            case 't' :
+            case 'L' :
+                mod = *format++;
+                break;
+        }
+
+        //Conversion.
+        switch (*format) {
+            case 'd' :
+            case 'i' : {
+                long long v;
+
+                switch (mod) {
+                    case 'l' :
+                        v = va_arg(args, long);
+                        break;
+                    case 'L' :
+                    case 'j' :
+                        v = va_arg(args, long long);
+                        break;
+                    case 'z' :
+                    case 't' :
+                        v = va_arg(args, ptrdiff_t);
+                        break;
+                    case 'h' :
+                        v = (short)va_arg(args, int);
+                        break;
+                    case 'H' :
+                        v = (signed char)va_arg(args, int);
+                        break;
+                    default :
+                        v = va_arg(args, int);
+                        break;
+                }
+
+                cnt += fmt_int(v < 0 ? 0 - (unsigned long long)v : (unsigned long long)v, v < 0, 10, flags, width, prec);
+                break;
+            }
+
+            case 'u' :
+            case 'o' :
+            case 'x' :
+            case 'X' : {
+                unsigned long long v;
+
+                switch (mod) {
+                    case 'l' :
+                        v = va_arg(args, unsigned long);
+                        break;
+                    case 'L' :
+                    case 'j' :
+                        v = va_arg(args, unsigned long long);
+                        break;
+                    case 'z' :
+                    case 't' :
+                        v = va_arg(args, size_t);
+                        break;
+                    case 'h' :
+                        v = (unsigned short)va_arg(args, unsigned int);
+                        break;
+                    case 'H' :
+                        v = (unsigned char)va_arg(args, unsigned int);
+                        break;
+                    default :
+                        v = va_arg(args, unsigned int);
+                        break;
+                }
+
+                if (*format == 'X') {
+                    flags |= FMT_UPPER;
+                }
+
+                flags &= ~(FMT_PLUS | FMT_SPACE);
+
+                cnt += fmt_int(v, false, (*format == 'u') ? 10 : (*format == 'o') ? 8 : 16, flags, width, prec);
+                break;
+            }
+
+            case 'p' :
+                cnt += fmt_int((unsigned long long)(size_t)va_arg(args, void *), false, 16, FMT_ALT | (flags & FMT_LEFT), width, -1);
+                break;
+
+            case 'e' :
+            case 'E' :
+            case 'f' :
+            case 'F' :
+            case 'g' :
+            case 'G' :
+                if (*format == 'E' || *format == 'F' || *format == 'G') {
+                    flags |= FMT_UPPER;
+                }
+
+                cnt += fmt_float(va_arg(args, double), *format | 0x20, flags, width, prec);
+                break;
+
+            case 'c' : {
+                char ch = (char)va_arg(args, int);
+
+                cnt += fmt_str(&ch, 1, flags, width);
+                break;
+            }
+
+            case 's' : {
+                const char *s = va_arg(args, const char *);
+                int len;
+
+                if (s == NULL) {
+                    s = "(null)";
+                }
+
+                //Do not read beyond the precision (the string may not be NULL-Terminated).
+                for (len = 0; (prec < 0 || len < prec) && s[len]; len++);
+
+                cnt += fmt_str(s, len, flags, width);
+                break;
+            }
+
+            case '%' :
+                cnt += txwrite(format, 1);
+                break;
+
+            case '\0' :
+                continue;
+
+            default :
+                //Unsupported, print it as is.
+                cnt += txwrite(format, 1);
+                break;
+        }
+
+        format++;
+    }
+
+    txhold--;
+
+    if (!txhold) {
+        flush();
+    }
+
+    return cnt;
+}
+
+int   Cmdb::print(const char *msg) {
+    int cnt = txwrite(msg, strlen(msg));
+
+    if (!txhold) {
+        flush();
+    }
+
+    return cnt;
+}
+
+int   Cmdb::println(const char *msg) {
+    int cnt = txwrite(msg, strlen(msg));
+
+    cnt += txwrite(crlf, sizeof(crlf) - 1);
+
+    if (!txhold) {
+        flush();
+    }
+
+    return cnt;
+}
+
+int   Cmdb::printsection(const char *section) {
+    return printf("[%s]\r\n", section);
+}
+
+int   Cmdb::printmsg(const char *msg) {
+    return printf("Msg=%s\r\n", msg);
+}
+
+int   Cmdb::printerror(const char *errormsg) {
+    int a = printsection("Error");
+    return a==0?a:a+printmsg(errormsg);
+}
+
+int   Cmdb::printerrorf(const char *format, ...) {
+    int cnt;
+
+    va_list args;
+
+    txhold++;
+
+    cnt  = printsection("Error");
+    cnt += txwrite("Msg=", 4);
+
+    va_start(args, format);
+    cnt += vprintf(format, args);
+    va_end(args);
+
+    cnt += txwrite(crlf, 2);
+
+    txhold--;
+
+    if (!txhold) {
+        flush();
+    }
+
+    return cnt;
+}
+
+int   Cmdb::printvaluef(const char *key, const char *format, ...) {
+    int cnt;
 
-    int a = printsection("Error");
-    
     va_list args;
+
+    txhold++;
+
+    cnt  = txwrite(key, strlen(key));
+    cnt += txwrite("=", 1);
+
     va_start(args, format);
+    cnt += vprintf(format, args);
+    va_end(args);
+
+    cnt += txwrite(crlf, 2);
+
+    txhold--;
+
+    if (!txhold) {
+        flush();
+    }
+
+    return cnt;
+}
+
+int   Cmdb::printvaluef(const char *key, const int width, const char *comment, const char *format, ...) {
+    int cnt;
+
+    va_list args;
+
+    txhold++;
+
+    cnt  = txwrite(key, strlen(key));
+    cnt += txwrite("=", 1);
+
+    va_start(args, format);
+    cnt += vprintf(format, args);
+    va_end(args);
+
+    if (comment!=NULL) {
+        //Align the comment at width.
+        if (cnt<width) {
+            cnt += txpad(' ', width - cnt - 1);
+        }
+
+        cnt += txwrite(" ; ", 3);
+        cnt += txwrite(comment, strlen(comment));
+    }
+
+    cnt += txwrite(crlf, 2);
+
+    txhold--;
+
+    if (!txhold) {
+        flush();
+    }
+
+    return cnt;
+}
+
+int   Cmdb::printvalue(const char *key, const char *value, const char *comment, const int width) {
+    if (comment) {
+        int  cnt = strlen(key) + 1 + strlen(value);
+        int  len = cnt;
+
+        txhold++;
+
+        txwrite(key, strlen(key));
+        txwrite("=", 1);
+        txwrite(value, strlen(value));
+
+        //Pad "key=value" to a field of width - cnt + 1 characters.
+        if (cnt<=width) {
+            len += txpad(' ', (width - cnt + 1) - cnt);
+        }
+
+        len += txwrite(" ; ", 3);
+        len += txwrite(comment, strlen(comment));
+        len += txwrite(crlf, 2);
+
+        txhold--;
+
+        if (!txhold) {
+            flush();
+        }
+
+        return len;
+    } else {
+        return printf("%s=%s\r\n", key, value);
+    }
+}
+
+int   Cmdb::printcomment(const char *comment, const int width) {
+    return printf("%-*s; %s\r\n", width, "", comment); 
+}
+
+char  Cmdb::printch(const char ch) {
+    txwrite(&ch, 1);
+
+    if (!txhold) {
+        flush();
+    }
+
+    return ch;
+}
+
+void  Cmdb::flush() {
+    if (txndx == 0) {
+        return;
+    }
+
+    if (tnstate) {
+        //Telnet: send every IAC (0xFF) twice.
+        const char *p   = txbuf;
+        const char *q   = txbuf;
+        const char *end = txbuf + txndx;
+
+        while ((q = (const char *)memchr(q, TN_IAC, end - q)) != NULL) {
+            q++;
+            txsend(p, q - p);                               //Up to and including the IAC,
+            p = q - 1;                                      //which also starts the next run.
+        }
+        txsend(p, end - p);
+    } else {
+        txsend(txbuf, txndx);
+    }
+
+    txndx = 0;
+    txflushes++;
+}
+
+void  Cmdb::txsend(const char *data, unsigned int len) {
+    unsigned int i = 0;
+
+    while (i < len) {
+        int n = transport->write(data + i, len - i);
+
+        if (n <= 0) {
+            break;                                          //Output lost.
+        }
+        i += n;
+    }
+}
+
+int   Cmdb::txwrite(const char *data, unsigned int len) {
+    unsigned int cnt = len;
+
+    while (len) {
+        unsigned int n = MAX_TX_LEN - txndx;
+
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(&txbuf[txndx], data, n);
+        txndx += n;
+        data  += n;
+        len   -= n;
+
+        if (txndx == MAX_TX_LEN) {
+            flush();
+        }
+    }
+
+    return cnt;
+}
+
+//------------------------------------------------------------------------------
+//----Formatting (streamed into the output buffer).
+//------------------------------------------------------------------------------
+
+int   Cmdb::txpad(const char c, int n) {
+    static const char spaces[] = "                ";
+    static const char zeros[]  = "0000000000000000";
+
+    int cnt = 0;
+
+    while (n > 0) {
+        int k = (n < (int)sizeof(spaces) - 1) ? n : (int)sizeof(spaces) - 1;
+
+        cnt += txwrite(c == '0' ? zeros : spaces, k);
+        n   -= k;
+    }
+
+    return cnt;
+}
+
+int   Cmdb::fmt_str(const char *s, int len, unsigned char flags, int width) {
+    int cnt = 0;
+
+    if (!(flags & FMT_LEFT)) {
+        cnt += txpad(' ', width - len);
+    }
+
+    cnt += txwrite(s, len);
+
+    if (flags & FMT_LEFT) {
+        cnt += txpad(' ', width - len);
+    }
+
+    return cnt;
+}
+
+int   Cmdb::fmt_int(unsigned long long mag, bool neg, unsigned int base, unsigned char flags, int width, int prec) {
+    const char *hex = (flags & FMT_UPPER) ? "0123456789ABCDEF" : "0123456789abcdef";
+
+    char digits[24];                                            //64 bit octal fits.
+    char prefix[2];
+
+    int n   = 0;
+    int pre = 0;
+    int cnt = 0;
+
+    //Digits (backwards), a precision of 0 prints nothing for 0.
+    if (mag != 0 || prec != 0) {
+        if (mag <= 0xFFFFFFFFul) {
+            unsigned long m = (unsigned long)mag;               //Avoid 64 bit divisions when possible.
+
+            do {
+                digits[sizeof(digits) - 1 - n++] = hex[m % base];
+                m /= base;
+            } while (m);
+        } else {
+            do {
+                digits[sizeof(digits) - 1 - n++] = hex[mag % base];
+                mag /= base;
+            } while (mag);
+        }
+    }
+
+    //Sign and 0x prefix.
+    if (neg) {
+        prefix[pre++] = '-';
+    } else if (flags & FMT_PLUS) {
+        prefix[pre++] = '+';
+    } else if (flags & FMT_SPACE) {
+        prefix[pre++] = ' ';
+    }
+
+    if ((flags & FMT_ALT) && base == 16 && n && digits[sizeof(digits) - n] != '0') {
+        prefix[pre++] = '0';
+        prefix[pre++] = (flags & FMT_UPPER) ? 'X' : 'x';
+    }
+
+    if ((flags & FMT_ALT) && base == 8 && (n == 0 || digits[sizeof(digits) - n] != '0') && prec <= n) {
+        prec = n + 1;
+    }
+
+    //Leading zeros.
+    int zeros = (prec > n) ? prec - n : 0;
+
+    if ((flags & FMT_ZERO) && !(flags & FMT_LEFT) && prec < 0 && width > pre + n) {
+        zeros = width - pre - n;
+    }
+
+    int pad = width - pre - zeros - n;
+
+    if (!(flags & FMT_LEFT)) {
+        cnt += txpad(' ', pad);
+    }
+
+    cnt += txwrite(prefix, pre);
+    cnt += txpad('0', zeros);
+    cnt += txwrite(&digits[sizeof(digits) - n], n);
+
+    if (flags & FMT_LEFT) {
+        cnt += txpad(' ', pad);
+    }
+
+    return cnt;
+}
+
+/** Rounds a positive value to an integer, ties to even (like printf).
+ */
+static unsigned long long round_even(double v) {
+    unsigned long long r = (unsigned long long)v;
+    double frac = v - (double)r;
+
+    if (frac > 0.5 || (frac == 0.5 && (r & 1))) {
+        r++;
+    }
+
+    return r;
+}
+
+/** Multiplies a value by 10^k using exact powers of ten.
+ */
+static double scale10(double v, int k) {
+    while (k > 22) {
+        v *= pow10tbl[22];
+        k -= 22;
+    }
+    while (k < -22) {
+        v /= pow10tbl[22];
+        k += 22;
+    }
+    return (k >= 0) ? v * pow10tbl[k] : v / pow10tbl[-k];
+}
+
+/** Converts a positive value to nd (at most 17) rounded significant digits.
+ *
+ * @param v the value.
+ * @param nd the number of digits.
+ * @param d receives the digits.
+ *
+ * @returns the decimal exponent of the first digit.
+ */
+static int fmt_digits(double v, int nd, char *d) {
+    int e = 0;
+
+    if (v == 0) {
+        memset(d, '0', nd);
+        return 0;
+    }
+
+    //Estimate the exponent.
+    double m = v;
+
+    while (m >= 1e16) {
+        m /= 1e16;
+        e += 16;
+    }
+    while (m >= 10) {
+        m /= 10;
+        e++;
+    }
+    while (m < 1e-16) {
+        m *= 1e16;
+        e -= 16;
+    }
+    while (m < 1) {
+        m *= 10;
+        e--;
+    }
+
+    //Round with a single scaling and correct the estimate if needed.
+    unsigned long long lo = (unsigned long long)pow10tbl[nd - 1];
+    unsigned long long r  = round_even(scale10(v, nd - 1 - e));
+
+    if (r >= lo * 10) {
+        e++;
+        r = round_even(scale10(v, nd - 1 - e));
+    } else if (r < lo) {
+        e--;
+        r = round_even(scale10(v, nd - 1 - e));
+    }
+
+    if (r >= lo * 10) {
+        r = lo;
+        e++;
+    }
+
+    for (int i = nd - 1; i >= 0; i--) {
+        d[i] = '0' + (char)(r % 10);
+        r /= 10;
+    }
+
+    return e;
+}
+
+int   Cmdb::fmt_float(double v, char conv, unsigned char flags, int width, int prec) {
+    char d[24];                                                 //Significant digits.
+    char sign = '\0';
+    char suffix[6];                                             //Exponent (e+XXX).
+
+    const char *id = d;                                         //Integer part digits,
+    int il  = 0;                                                //their number
+    int iz  = 0;                                                //and trailing zeros.
+    int flz = 0;                                                //Fraction leading zeros,
+    const char *fd = d;                                         //digits,
+    int fl  = 0;                                                //their number
+    int fz  = 0;                                                //and trailing zeros.
+    int sl  = 0;                                                //Suffix length.
+    int cnt = 0;
+
+    if (v < 0) {
+        sign = '-';
+        v = -v;
+    } else if (flags & FMT_PLUS) {
+        sign = '+';
+    } else if (flags & FMT_SPACE) {
+        sign = ' ';
+    }
+
+    //Not a number and infinity.
+    if (v != v || v > 1.7976931348623157e308) {
+        const char *s = (v != v) ? ((flags & FMT_UPPER) ? "NAN" : "nan") : ((flags & FMT_UPPER) ? "INF" : "inf");
+        int len = 3 + (sign ? 1 : 0);
+
+        if (!(flags & FMT_LEFT)) {
+            cnt += txpad(' ', width - len);
+        }
+        if (sign) {
+            cnt += txwrite(&sign, 1);
+        }
+        cnt += txwrite(s, 3);
+        if (flags & FMT_LEFT) {
+            cnt += txpad(' ', width - len);
+        }
+
+        return cnt;
+    }
+
+    if (prec < 0) {
+        prec = 6;
+    }
+
+    bool strip = false;
+    int  x     = 0;                                             //Decimal exponent for %e.
+
+    if (conv == 'g') {
+        int p  = (prec == 0) ? 1 : prec;
+        int nd = (p < 17) ? p : 17;
+
+        x = fmt_digits(v, nd, d);
+
+        if (p > x && x >= -4) {
+            conv = 'F';                                         //%f style with p-1-x decimals.
+            if (x >= 0) {
+                il = (x + 1 < nd) ? x + 1 : nd;
+                iz = x + 1 - il;
+                fd = d + il;
+                fl = nd - il;
+                fz = (p - 1 - x) - fl;
+            } else {
+                id  = "0";
+                il  = 1;
+                flz = -x - 1;
+                fl  = nd;
+                fz  = p - nd;
+            }
+        } else {
+            conv = 'E';                                         //%e style with p-1 decimals.
+            il = 1;
+            fd = d + 1;
+            fl = nd - 1;
+            fz = p - nd;
+        }
+
+        strip = !(flags & FMT_ALT);
+    } else if (conv == 'e') {
+        int nd = (prec + 1 < 17) ? prec + 1 : 17;
+
+        x  = fmt_digits(v, nd, d);
+        il = 1;
+        fd = d + 1;
+        fl = nd - 1;
+        fz = prec + 1 - nd;
+        conv = 'E';
+    } else {
+        double s = (prec <= 22) ? scale10(v, prec) : 1e17;
+
+        if (s < 1e17) {
+            //Common case, round to an integer and place the decimal point.
+            unsigned long long r = round_even(s);
+            int n = 0;
+
+            char *p = d + sizeof(d);
+
+            do {
+                *--p = '0' + (char)(r % 10);
+                r /= 10;
+                n++;
+            } while (r);
+
+            if (n > prec) {
+                id = p;
+                il = n - prec;
+                fd = p + il;
+                fl = prec;
+            } else {
+                id  = "0";
+                il  = 1;
+                flz = prec - n;
+                fd  = p;
+                fl  = n;
+            }
+        } else {
+            //Huge, print 17 significant digits followed by zeros.
+            x = fmt_digits(v, 17, d);
+
+            if (x >= 16) {
+                il = 17;
+                iz = x - 16;
+                fz = prec;
+            } else {
+                il = x + 1;
+                fd = d + il;
+                fl = (17 - il < prec) ? 17 - il : prec;
+                fz = prec - fl;
+            }
+        }
+    }
+
+    if (strip) {
+        fz = 0;
+        while (fl > 0 && fd[fl - 1] == '0') {
+            fl--;
+        }
+        if (fl == 0) {
+            flz = 0;
+        }
+    }
+
+    if (conv == 'E') {
+        int ax = (x < 0) ? -x : x;
+
+        suffix[sl++] = (flags & FMT_UPPER) ? 'E' : 'e';
+        suffix[sl++] = (x < 0) ? '-' : '+';
+        if (ax >= 100) {
+            suffix[sl++] = '0' + (char)(ax / 100);
+        }
+        suffix[sl++] = '0' + (char)((ax / 10) % 10);
+        suffix[sl++] = '0' + (char)(ax % 10);
+    }
+
+    bool dot = (flz + fl + fz > 0) || (flags & FMT_ALT);
+
+    int len = (sign ? 1 : 0) + il + iz + (dot ? 1 : 0) + flz + fl + fz + sl;
+    int pad = width - len;
+
+    if (!(flags & FMT_LEFT) && !(flags & FMT_ZERO)) {
+        cnt += txpad(' ', pad);
+    }
+    if (sign) {
+        cnt += txwrite(&sign, 1);
+    }
+    if (!(flags & FMT_LEFT) && (flags & FMT_ZERO)) {
+        cnt += txpad('0', pad);
+    }
+
+    cnt += txwrite(id, il);
+    cnt += txpad('0', iz);
+
+    if (dot) {
+        cnt += txwrite(".", 1);
+    }
+
+    cnt += txpad('0', flz);
+    cnt += txwrite(fd, fl);
+    cnt += txpad('0', fz);
+    cnt += txwrite(suffix, sl);
+
+    if (flags & FMT_LEFT) {
+        cnt += txpad(' ', pad);
+    }
+
+    return cnt;
+}
+
+//Mode=1               ; Profile Position Mode
+//1234567890123456789012
+
+//------------------------------------------------------------------------------
+
+void  Cmdb::init(const char full) {
+    if (full) {
+        echo = true;
+        bold = true;
+
+        subsystem = -1;
+
+        lstbuf [cmdndx] = '\0';
+
+        macro_reset();
+
+        prompt();
+    }
+
+    cmdndx = 0;
+    cmdbuf [cmdndx] = '\0';
+
+    escndx = 0;
+    escbuf [escndx] = '\0';
+}
+
+//------------------------------------------------------------------------------
+//Private Stuff.
+//------------------------------------------------------------------------------
+
+int  Cmdb::escid_search(char *escstr) {
+    for (int i=0; i<ESC_TBL_LEN; i++) {
+        if (strcmp (esc_tbl[i].escstr, escstr) == 0)
+            return (esc_tbl[i].id);
+    }
+
+    return (EID_LAST);
+}
+
+int  Cmdb::cmdid_search(const char *cmdstr, unsigned int len) {
+    //Returns the ID, cmdid_index() maps it to the array index (CMDB_VALIDATE() rejects duplicate ID's).
+    int ndx = table->search(cmdstr, len, subsystem);
+
+    return (ndx == -1) ? CID_LAST : table->entry(ndx).cid;
+}
+
+int  Cmdb::cmdid_index(int cmdid) {
+    return table->index(cmdid);
+}
+
+void  Cmdb::replace(std::vector<cmd> &newcmds) {
+    //Never modifies a shared table, the instance switches to its own copy.
+    CmdbTable *old = owntable;
+
+    owntable = new CmdbTable(newcmds);
+    table    = owntable;
+
+    delete old;
+}
+
+//------------------------------------------------------------------------------
+
+CmdbTable::CmdbTable(const std::vector<cmd>& _cmds) :
+        store(_cmds) {
+    tbl   = store.empty() ? NULL : &store[0];
+    count = store.size();
+
+    pre.slot = NULL;
+
+    reindex();
+}
+
+CmdbTable::CmdbTable(const cmd *_cmds, unsigned int _count) :
+        tbl(_cmds), count(_count) {
+    pre.slot = NULL;
+
+    builtins();
+    reindex();
+}
+
+/** The predefined commands served by the array constructors of CmdbTable.
+ *
+ * BOOT resets the board so it must be added explicitly. HELP is last, as
+ * the help listing ends with the last command.
+ */
+static const cmd *const predefined[] = {
+    &COMMANDS,
+#ifdef ENABLEMACROS
+    &MACRO,
+    &RUN,
+    &MACROS,
+#endif
+    &ECHO,
+    &BOLD,
+    &CLS,
+    &IDLE,
+    &HELP
+};
+
+void  CmdbTable::builtins() {
+    for (unsigned int i=0; i<sizeof(predefined)/sizeof(predefined[0]); i++) {
+        unsigned int j;
+
+        for (j=0; j<count && tbl[j].cid!=predefined[i]->cid; j++);
+
+        if (j==count) {
+            extra.push_back(predefined[i]);
+        }
+    }
+}
+
+int  CmdbTable::search(const char *cmdstr, unsigned int len, int subsystem) const {
+    unsigned int hash = FNV_BASIS;
+
+    //Hash the upper-cased command.
+    for (unsigned int i=0; i<len; i++) {
+        hash = (hash ^ (unsigned char)fold(cmdstr[i])) * FNV_PRIME;
+    }
+
+    //Compile-time index: a single slot per name, with equal names chained in table order.
+    if (pre.slot) {
+        unsigned int d = pre.disp[cmdb_mix(hash, 0, pre.bbits)];
+
+        for (int i = pre.slot[cmdb_mix(hash, d + 1, pre.bits)] - 1; i != -1; i = pre.next[i] - 1) {
+            const char *name = &names[keys[i].name];
+            unsigned int j;
+
+            if (keys[i].hash != hash || keys[i].len != len) {
+                break;
+            }
+
+            for (j = 0; j < len && fold(cmdstr[j]) == name[j]; j++);
+
+            if (j != len) {
+                break;
+            }
+
+            if ((entry(i).subs == subsystem) || (entry(i).subs < 0)) {
+                return i;
+            }
+        }
+
+        //Not found, the runtime slots below only contain the predefined commands in extra.
+    }
+
+    //Linear probing keeps equal names in table order, so the first visible match wins.
+    unsigned int mask = slots.size() - 1;
+
+    for (unsigned int p = hash & mask; slots[p] != -1; p = (p + 1) & mask) {
+        int i = slots[p];
+
+        if (keys[i].hash != hash || keys[i].len != len) {
+            continue;
+        }
+
+        if ((entry(i).subs != subsystem) && (entry(i).subs >= 0)) {
+            continue;
+        }
+
+        const char *name = &names[keys[i].name];
+        unsigned int j;
+
+        for (j = 0; j < len && fold(cmdstr[j]) == name[j]; j++);
+
+        if (j == len) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int  CmdbTable::index(int cid) const {
+    if (pre.slot) {
+        unsigned int d = pre.ciddisp[cmdb_mix((unsigned int)cid, 0, pre.bbits)];
+        int i = pre.cidslot[cmdb_mix((unsigned int)cid, d + 1, pre.bits)] - 1;
+
+        if (i != -1 && tbl[i].cid == cid) {
+            return i;
+        }
+    }
+
+    unsigned int mask = cidslots.size() - 1;
+
+    for (unsigned int p = (unsigned int)cid & mask; cidslots[p] != -1; p = (p + 1) & mask) {
+        if (entry(cidslots[p]).cid==cid)
+            return cidslots[p];
+    }
+
+    return -1;
+}
+
+void  CmdbTable::reindex() {
+    unsigned int n    = size();
+    unsigned int size = 2;
+
+    //Keep the load factor at or below 50%, so there is always an empty slot.
+    while (size < 2 * n) {
+        size <<= 1;
+    }
+
+    keys.resize(n);
+    names.clear();
+    sigs.clear();
+    symbols.assign(2, symkey());                               //The empty hash, shared.
+    defaults.clear();
+    failed = 0;
+    slots.assign(size, -1);
+    cidslots.assign(size, -1);
+
+    std::vector<char> list;                                     //Keys of the named parameters of a command.
+
+    for (unsigned int i=0; i<n; i++) {
+        unsigned int hash = FNV_BASIS;
+        unsigned int len  = 0;
+
+        keys[i].name = names.size();
+
+        for (; entry(i).cmdstr[len]; len++) {
+            char c = fold(entry(i).cmdstr[len]);
+
+            names.push_back(c);
+            hash = (hash ^ (unsigned char)c) * FNV_PRIME;
+        }
+        names.push_back('\0');
+
+        keys[i].hash = hash;
+        keys[i].len  = len;
+
+        //Compile the space separated parameter patterns (key=%spec=default, key and default optional).
+        const char *parm = entry(i).parms;
+        bool ordered     = true;
+
+        keys[i].sig   = sigs.size();
+        keys[i].argc  = 0;
+        keys[i].named = 0xFF;
+
+        list.clear();
+
+        while (*parm) {
+            unsigned int plen = strcspn(parm, " ");
+
+            if (plen && keys[i].argc < MAX_ARGS) {
+                unsigned int klen = strcspn(parm, "% ");
+
+                if (klen==plen) {
+                    klen = 0;                                   //No %, compiled as an unused parameter.
+                }
+
+                const char *spec   = parm + klen;
+                unsigned int slen  = spec[1]=='{' ? strcspn(spec, "} ") + 1 : strcspn(spec, "= ");
+
+                if (slen > plen - klen) {
+                    slen = plen - klen;
+                }
+
+                sigs.push_back(Cmdb::compile(spec, slen));
+                keys[i].argc++;
 
-    vsnprintf(buf, sizeof(buf), format, args);
+                if (sigs.back().typ=='{') {
+                    hashenum(sigs.back(), spec + 2, slen - 3);
+                }
 
-    va_end(args);
+                //Named parameters come last, their keys get a hash per command.
+                if (klen) {
+                    if (keys[i].named==0xFF) {
+                        keys[i].named = keys[i].argc - 1;
+                    }
+                    if (!list.empty()) {
+                        list.push_back('|');
+                    }
+                    list.insert(list.end(), parm, parm + klen - 1);
+                } else if (keys[i].named!=0xFF && sigs.back().type!=Cmdb::PARM_ARRAY) {
+                    ordered = false;
+                }
+
+                //Defaults are converted below, once names no longer grows (strings and blobs point into it).
+                if (klen + slen < plen) {
+                    Cmdb::parm def;
+
+                    def.type   = Cmdb::PARM_UNUSED;
+                    def.len    = plen - klen - slen - 1;
+                    def.val.ul = names.size();
+
+                    names.insert(names.end(), spec + slen + 1, spec + slen + 1 + def.len);
+                    names.push_back('\0');
+
+                    defaults.push_back(def);
+                    sigs.back().def = defaults.size();
+                }
+            }
+
+            parm += plen;
+            parm += strspn(parm, " ");
+        }
+
+        if (keys[i].named==0xFF) {
+            keys[i].named = keys[i].argc;
+        }
+
+        //Keys out of order match nothing (CMDB_VALIDATE rejects them).
+        Cmdb::parmdesc keyhash;
+
+        hashenum(keyhash, list.empty() ? "" : &list[0], ordered ? list.size() : 0);
+
+        keys[i].kbits = keyhash.bits;
+        keys[i].kslot = keyhash.slot;
+        keys[i].kseed = keyhash.seed;
+
+        unsigned int p = hash & (size - 1);
+
+        //Commands covered by a compile-time index are not added to the runtime slots.
+        if (pre.slot && i < count) {
+            continue;
+        }
+
+        while (slots[p] != -1) {
+            p = (p + 1) & (size - 1);
+        }
+        slots[p] = i;
+
+        //Only the first command with a given cid is reachable (as before).
+        p = (unsigned int)entry(i).cid & (size - 1);
+
+        while (cidslots[p] != -1 && entry(cidslots[p]).cid != entry(i).cid) {
+            p = (p + 1) & (size - 1);
+        }
+        if (cidslots[p] == -1) {
+            cidslots[p] = i;
+        }
+    }
+
+    //Convert the defaults, one that does not convert is counted and leaves its parameter required.
+    for (unsigned int i=0; i<n; i++) {
+        for (unsigned int j=keys[i].sig; j<keys[i].sig + keys[i].argc; j++) {
+            if (sigs[j].def==0) {
+                continue;
+            }
+
+            Cmdb::parm &def = defaults[sigs[j].def - 1];
 
-    return a +  printf("Msg=%s\r\n", buf);
+            if (sigs[j].type==Cmdb::PARM_ARRAY || !Cmdb::convert(*this, sigs[j], &names[def.val.ul], def.len, def)) {
+                sigs[j].def = 0;
+                failed++;
+            }
+        }
+    }
 }
 
-int   Cmdb::printvaluef(const char *key, const char *format, ...) {
-    char buf[256];
+void  CmdbTable::hashenum(Cmdb::parmdesc &desc, const char *list, unsigned int len) {
+    std::vector<unsigned int> hash;
+    std::vector<unsigned int> name;
+    std::vector<unsigned char> slen;
+    unsigned int n  = 0;
+    bool ok         = true;
 
-    va_list args;
-    va_start(args, format);
+    //Split and upper-case the symbols.
+    for (unsigned int i=0; i<len && ok; ) {
+        unsigned int l = 0;
+
+        if (n==255) {
+            ok = false;
+            break;
+        }
 
-    vsnprintf(buf, sizeof(buf), format, args);
+        hash.push_back(FNV_BASIS);
+        name.push_back(names.size());
 
-    va_end(args);
+        for (; i+l<len && list[i+l]!='|'; l++) {
+            char c = fold(list[i+l]);
+
+            names.push_back(c);
+            hash[n] = (hash[n] ^ (unsigned char)c) * FNV_PRIME;
+        }
+        names.push_back('\0');
+
+        slen.push_back(l);
+        ok = l>0 && l<256;
+
+        //Duplicates would never hash apart.
+        for (unsigned int j=0; j<n && ok; j++) {
+            ok = !(hash[j]==hash[n] && slen[j]==l && memcmp(&names[name[j]], &names[name[n]], l)==0);
+        }
+
+        n++;
+        i += l + 1;
+    }
+
+    //The empty hash (at slot 0) matches nothing.
+    desc.bits = 1;
+    desc.seed = 0;
+    desc.slot = 0;
+
+    if (!ok || n==0) {
+        return;
+    }
+
+    //Search a seed without collisions at a load factor of at most 50%, widen if that takes too long.
+    for (desc.bits = 1; (1u << desc.bits) < 2 * n; desc.bits++);
+
+    std::vector<unsigned char> used;
+
+    for (;;) {
+        unsigned int seed;
+
+        for (seed = 1; seed <= 1024; seed++) {
+            unsigned int j;
+
+            used.assign(1u << desc.bits, 0);
+
+            for (j=0; j<n; j++) {
+                unsigned int p = cmdb_mix(hash[j], seed, desc.bits);
+
+                if (used[p]) {
+                    break;
+                }
+                used[p] = 1;
+            }
+
+            if (j==n) {
+                break;
+            }
+        }
+
+        if (seed <= 1024) {
+            desc.seed = seed;
+            break;
+        }
+
+        if (desc.bits==12) {
+            //Practically unreachable (255 symbols in 4096 slots), match nothing.
+            desc.bits = 1;
+            return;
+        }
+        desc.bits++;
+    }
+
+    desc.slot = symbols.size();
+    symbols.resize(symbols.size() + (1u << desc.bits));
+
+    for (unsigned int j=0; j<n; j++) {
+        symkey &key = symbols[desc.slot + cmdb_mix(hash[j], desc.seed, desc.bits)];
 
-    return printf("%s=%s\r\n",key, buf);
+        key.name = name[j];
+        key.len  = slen[j];
+        key.ndx  = j + 1;
+    }
 }
 
-int   Cmdb::printvaluef(const char *key, const int width, const char *comment, const char *format, ...) {
-    char buf[256];
-    
-    int  cnt = printf("%s=",key);
+int  CmdbTable::symbol(const Cmdb::parmdesc &desc, const char *sym, unsigned int len) const {
+    return probe(desc.slot, desc.seed, desc.bits, sym, len);
+}
 
-    va_list args;
-    va_start(args, format);
+int  CmdbTable::probe(unsigned int slot, unsigned int seed, unsigned int bits, const char *sym, unsigned int len) const {
+    unsigned int hash = FNV_BASIS;
 
-    vsnprintf(buf, sizeof(buf), format, args);
-   
-    va_end(args);
+    for (unsigned int i=0; i<len; i++) {
+        hash = (hash ^ (unsigned char)fold(sym[i])) * FNV_PRIME;
+    }
 
-    if (comment!=NULL) {
-        cnt += printf("%s", buf);
+    //A single probe, the symbol itself is compared as the slot may belong to another.
+    const symkey &key = symbols[slot + cmdb_mix(hash, seed, bits)];
+    const char *name  = &names[key.name];
+    unsigned int j;
 
-        if (cnt<width) {
-            cnt += printf("%-*s ; %s\r\n", width - cnt - 1, "", comment);
-        } else {
-            cnt += printf("%s ; %s\r\n", "", comment);
+    if (key.ndx==0 || key.len!=len) {
+        return -1;
+    }
+
+    for (j = 0; j < len && fold(sym[j]) == name[j]; j++);
+
+    return j==len ? key.ndx - 1 : -1;
+}
+
+Cmdb::parmdesc  Cmdb::compile(const char *pattern, unsigned int len) {
+    parmdesc desc;
+
+    char mod = '\0';                                            //Var modifier      (for cardinal types)
+    bool array = false;                                         //Array (%*d etc)
+
+    desc.type  = PARM_UNUSED;
+    desc.typ   = '\0';
+    desc.conv  = NULL;
+    desc.aconv = NULL;
+    desc.size  = 0;
+    desc.bits  = 0;
+    desc.slot  = 0;
+    desc.def   = 0;
+    desc.seed  = 0;
+
+    //Enum (%{a|b|c}), its symbol hash is built by CmdbTable.
+    if (len>=4 && pattern[1]=='{' && pattern[len-1]=='}') {
+        desc.type=PARM_INT;
+        desc.typ='{';
+        return desc;
+    }
+
+    if (len>=3 && pattern[1]=='*') {
+        array = true;
+        pattern++;
+        len--;
+    }
+
+    switch (len) {
+        case 2: //Simple pattern, no modifier
+            desc.typ=pattern[1];
+            break;
+        case 3: //pattern with Modifier.
+            mod=pattern[1];
+            desc.typ=pattern[2];
+            break;
+        default:
+            return desc;
+    }
+
+    switch (desc.typ) {
+        //Signed Cardinal Types
+        case 'd' :
+        case 'i' :
+            switch (mod) {
+                case 'b' : //char
+                    desc.type=PARM_CHAR;
+                    cardinal<signed char>(desc);
+                    break;
+                case 'h' : //short
+                    desc.type=PARM_SHORT;
+                    cardinal<short>(desc);
+                    break;
+                case 'l' : //long
+                    desc.type=PARM_LONG;
+                    cardinal<long>(desc);
+                    break;
+                default: //int
+                    desc.type=PARM_INT;
+                    cardinal<int>(desc);
+                    break;
+            }
+            break;
+
+        //Unsigned Cardinal Types
+        case 'u' :
+        case 'o' :
+        case 'x' :
+            switch (mod) {
+                case 'b' : //char
+                    desc.type=PARM_CHAR;
+                    cardinal<unsigned char>(desc);
+                    break;
+                case 'h' : //short
+                    desc.type=PARM_SHORT;
+                    cardinal<unsigned short>(desc);
+                    break;
+                case 'l' : //long
+                    desc.type=PARM_LONG;
+                    cardinal<unsigned long>(desc);
+                    break;
+                default: //int
+                    desc.type=PARM_INT;
+                    cardinal<unsigned int>(desc);
+                    break;
+            }
+            break;
+
+        //Floating Point Types
+        case 'e' :
+        case 'f' :
+        case 'g' :
+            desc.type=PARM_FLOAT;
+            desc.conv=&Cmdb::to_float;
+            desc.aconv=&Cmdb::to_floats;
+            desc.size=sizeof(float);
+            break;
+
+        //String types
+        case 'c' :
+            desc.type=PARM_CHAR;
+            break;
+        case 's' :
+            desc.type=PARM_STRING;
+            break;
+
+        //Blob types
+        case 'H' :
+        case 'B' :
+            desc.type=PARM_BLOB;
+            break;
+
+        default:
+            desc.typ='\0';
+            break;
+    }
+
+    //Arrays of strings, chars or blobs are not supported.
+    if (array) {
+        desc.type = desc.aconv ? PARM_ARRAY : PARM_UNUSED;
+        desc.typ  = desc.aconv ? desc.typ : '\0';
+    }
+
+    return desc;
+}
+
+template <typename T>
+void  Cmdb::cardinal(parmdesc &desc) {
+    switch (desc.typ) {
+        case 'o' :
+            desc.conv=&Cmdb::to_int<T, 8>;
+            desc.aconv=&Cmdb::to_ints<T, 8>;
+            break;
+        case 'x' :
+            desc.conv=&Cmdb::to_int<T, 16>;
+            desc.aconv=&Cmdb::to_ints<T, 16>;
+            break;
+        default :
+            desc.conv=&Cmdb::to_int<T, 10>;
+            desc.aconv=&Cmdb::to_ints<T, 10>;
+            break;
+    }
+
+    desc.size=sizeof(T);
+}
+
+//------------------------------------------------------------------------------
+//----Conversion kernels.
+//------------------------------------------------------------------------------
+
+/** Converts a character to its digit value.
+ *
+ * @returns the digit value or 36 for non alphanumeric characters.
+ */
+static inline unsigned int digit(const char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') {
+        return (c | 0x20) - 'a' + 10;
+    }
+    return 36;
+}
+
+template <typename T, unsigned int base>
+bool  Cmdb::to_int(const char *first, const char *last, value &val) {
+    const char *p = first;
+    bool neg = false;
+
+    //Optional sign, unsigned types only accept a '+'.
+    if (p != last && (*p == '-' || *p == '+')) {
+        neg = (*p++ == '-');
+
+        if (neg && !std::numeric_limits<T>::is_signed) {
+            return false;
+        }
+    }
+
+    //Optional 0x prefix (like strtol).
+    if (base == 16 && last - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x') {
+        p += 2;
+    }
+
+    if (p == last) {
+        return false;                                           //No Conversion at all.
+    }
+
+    //Magnitude limit, the cutoff makes the overflow test a compare per digit.
+    const unsigned long limit  = neg ? (unsigned long)std::numeric_limits<T>::max() + 1
+                                     : (unsigned long)std::numeric_limits<T>::max();
+    const unsigned long cutoff = limit / base;
+    const unsigned int  cutlim = limit % base;
+
+    unsigned long v = 0;
+
+    for (; p != last; p++) {
+        unsigned int d = digit(*p);
+
+        if (d >= base) {
+            return false;                                       //Incomplete conversion.
+        }
+
+        if (v > cutoff || (v == cutoff && d > cutlim)) {
+            return false;                                       //Out of range.
         }
+
+        v = v * base + d;
+    }
+
+    //Store at full width (zero extended below int, like the parm union used to be zeroed).
+    if (sizeof(T) == sizeof(char)) {
+        val.ul = (unsigned char)(neg ? 0 - v : v);
+    } else if (sizeof(T) == sizeof(short)) {
+        val.ul = (unsigned short)(neg ? 0 - v : v);
+    } else if (sizeof(T) == sizeof(int) && std::numeric_limits<T>::is_signed) {
+        val.l = neg ? -(int)(v - 1) - 1 : (int)v;
+    } else if (sizeof(T) == sizeof(int)) {
+        val.ul = (unsigned int)v;
     } else {
-        cnt += printf("%s\r\n",buf);
+        val.ul = neg ? 0 - v : v;
     }
 
-    return cnt;
+    return true;
 }
 
-int   Cmdb::printvalue(const char *key, const char *value, const char *comment, const int width) {
-    if (comment) {
-        char buf[256];
-        int  cnt = 0;
+bool  Cmdb::to_float(const char *first, const char *last, value &val) {
+    const char *p = first;
+    bool neg = false;
 
-        memset(buf,'\0',sizeof(buf));
+    unsigned long mant = 0;                                     //First 9 significant digits.
+    int digits = 0;                                             //Significant digits seen.
+    int exp10  = 0;                                             //Decimal exponent of mant.
+    bool any   = false;                                         //Any digit seen.
 
-        cnt = snprintf(buf, sizeof(buf), "%s=%s", key, value);
+    if (p != last && (*p == '-' || *p == '+')) {
+        neg = (*p++ == '-');
+    }
 
-        if (cnt<=width) {
-            return printf("%-*s ; %s\r\n", width - cnt + 1, buf, comment);
+    //Integer part.
+    for (; p != last && *p >= '0' && *p <= '9'; p++) {
+        any = true;
+        if (digits < 9) {
+            if (mant || *p != '0') {
+                mant = mant * 10 + (*p - '0');
+                digits++;
+            }
         } else {
-            return printf("%s ; %s\r\n", buf, comment);
+            exp10++;
         }
-    } else {
-        return printf("%s=%s\r\n", key, value);
     }
-}
 
-int   Cmdb::printcomment(const char *comment, const int width) {
-    return printf("%-*s; %s\r\n", width, "", comment); 
-}
+    //Fraction.
+    if (p != last && *p == '.') {
+        for (p++; p != last && *p >= '0' && *p <= '9'; p++) {
+            any = true;
+            if (digits < 9) {
+                if (mant || *p != '0') {
+                    mant = mant * 10 + (*p - '0');
+                    digits++;
+                }
+                exp10--;
+            }
+        }
+    }
 
-char  Cmdb::printch(const char ch) {
-    return serial->putc(ch);
+    if (!any) {
+        return false;                                           //No Conversion at all.
+    }
+
+    //Exponent.
+    if (p != last && (*p | 0x20) == 'e') {
+        bool eneg = false;
+        int e = 0;
+
+        p++;
+        if (p != last && (*p == '-' || *p == '+')) {
+            eneg = (*p++ == '-');
+        }
+
+        if (p == last) {
+            return false;
+        }
+
+        for (; p != last && *p >= '0' && *p <= '9'; p++) {
+            if (e < 1000) {
+                e = e * 10 + (*p - '0');
+            }
+        }
+
+        exp10 += eneg ? -e : e;
+    }
+
+    if (p != last) {
+        return false;                                           //Incomplete conversion.
+    }
+
+    double d = mant;
+
+    if (mant != 0) {
+        //Scale in steps of at most 1e22 (exact powers of ten in a double).
+        while (exp10 > 22 && d <= std::numeric_limits<float>::max()) {
+            d *= pow10tbl[22];
+            exp10 -= 22;
+        }
+        while (exp10 < -22 && d != 0) {
+            d /= pow10tbl[22];
+            exp10 += 22;
+        }
+        if (d == 0 || exp10 < -22) {
+            val.f = neg ? -0.0f : 0.0f;                         //Underflow, a signed zero.
+            return true;
+        }
+        if (exp10 > 22) {
+            return false;                                       //Out of range.
+        }
+        d = (exp10 >= 0) ? d * pow10tbl[exp10] : d / pow10tbl[-exp10];
+
+        if (d > std::numeric_limits<float>::max()) {
+            return false;                                       //Out of range.
+        }
+    }
+
+    val.f = (float)(neg ? -d : d);
+
+    return true;
 }
 
-//Mode=1               ; Profile Position Mode
-//1234567890123456789012
+template <typename T, unsigned int base>
+int  Cmdb::to_ints(const char *first, const char *last, void *buf, unsigned int max) {
+    T *out = (T *)buf;
+    unsigned int n = 0;
+    value val;
 
-//------------------------------------------------------------------------------
+    for (const char *p = first; ; ) {
+        while (p != last && *p == ' ') {
+            p++;
+        }
 
-void  Cmdb::init(const char full) {
-    if (full) {
-        echo = true;
-        bold = true;
+        if (p == last) {
+            return n;
+        }
 
-        subsystem = -1;
+        const char *tok = p;
 
-        lstbuf [cmdndx] = '\0';
+        while (p != last && *p != ' ') {
+            p++;
+        }
 
-        macro_reset();
+        if (n == max || !to_int<T, base>(tok, p, val)) {
+            return -1;
+        }
 
-        prompt();
+        out[n++] = (T)val.ul;                                   //Stored at full width, zero or sign extended.
     }
+}
 
-    cmdndx = 0;
-    cmdbuf [cmdndx] = '\0';
+int  Cmdb::to_floats(const char *first, const char *last, void *buf, unsigned int max) {
+    float *out = (float *)buf;
+    unsigned int n = 0;
+    value val;
 
-    escndx = 0;
-    escbuf [escndx] = '\0';
+    for (const char *p = first; ; ) {
+        while (p != last && *p == ' ') {
+            p++;
+        }
+
+        if (p == last) {
+            return n;
+        }
+
+        const char *tok = p;
+
+        while (p != last && *p != ' ') {
+            p++;
+        }
+
+        if (n == max || !to_float(tok, p, val)) {
+            return -1;
+        }
+
+        out[n++] = val.f;
+    }
 }
 
 //------------------------------------------------------------------------------
-//Private Stuff.
+//----Blob decoders.
 //------------------------------------------------------------------------------
 
-int  Cmdb::escid_search(char *escstr) {
-    for (int i=0; i<ESC_TBL_LEN; i++) {
-        if (strcmp (esc_tbl[i].escstr, escstr) == 0)
-            return (esc_tbl[i].id);
+/** Hex digit values, 0x80 for anything else.
+ */
+static const unsigned char hexval[256] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+
+/** Base64 (RFC 4648) digit values, 0x80 for anything else (including the '=' padding).
+ */
+static const unsigned char b64val[256] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x3E, 0x80, 0x80, 0x80, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+
+int  Cmdb::hex_decode(char *first, unsigned int len) {
+    const unsigned char *in = (const unsigned char *)first;
+    unsigned char *out      = (unsigned char *)first;
+    unsigned int bad        = (len & 1) ? 0x80 : 0;
+
+    //Invalid digits (0x80) are or-ed into bad, one test after the loop.
+    for (unsigned int i = 0; i < len / 2; i++) {
+        const unsigned int hi = hexval[in[2 * i]];
+        const unsigned int lo = hexval[in[2 * i + 1]];
+
+        bad   |= hi | lo;
+        out[i] = (unsigned char)((hi << 4) | lo);
     }
 
-    return (EID_LAST);
+    return (bad & 0x80) ? -1 : (int)(len / 2);
 }
 
-int  Cmdb::cmdid_search(char *cmdstr) {
-    //Warning, we return the ID but somewhere assume it's equal to the array index!
-    for (int i=0; i<cmds.size(); i++) {
-        if ((stricmp((char*)cmds[i].cmdstr, cmdstr) == 0) && ((cmds[i].subs == subsystem) || (cmds[i].subs<0)))
-            return (cmds[i].cid);
+int  Cmdb::b64_decode(char *first, unsigned int len) {
+    const unsigned char *in = (const unsigned char *)first;
+    unsigned char *out      = (unsigned char *)first;
+    unsigned int bad        = 0;
+    unsigned int n          = 0;
+
+    //Padding is optional.
+    if (len >= 4 && (len & 3) == 0 && in[len - 1] == '=') {
+        len -= (in[len - 2] == '=') ? 2 : 1;
     }
 
-    return CID_LAST;
-}
+    if ((len & 3) == 1) {
+        return -1;
+    }
 
-int  Cmdb::cmdid_index(int cmdid) {
-    for (int i=0; i<cmds.size(); i++) {
-        if (cmds[i].cid==cmdid)
-            return i;
+    //Invalid digits (0x80) are or-ed into bad, one test after the loop.
+    for (unsigned int i = 0; i + 4 <= len; i += 4) {
+        const unsigned int a = b64val[in[i]];
+        const unsigned int b = b64val[in[i + 1]];
+        const unsigned int c = b64val[in[i + 2]];
+        const unsigned int d = b64val[in[i + 3]];
+        const unsigned long v = ((unsigned long)a << 18) | (b << 12) | (c << 6) | d;
+
+        bad     |= a | b | c | d;
+        out[n++] = (unsigned char)(v >> 16);
+        out[n++] = (unsigned char)(v >> 8);
+        out[n++] = (unsigned char)v;
     }
 
-    return -1;
+    //A tail of 2 or 3 digits holds 1 or 2 bytes.
+    if (len & 3) {
+        const unsigned int i = len & ~3u;
+        const unsigned int a = b64val[in[i]];
+        const unsigned int b = b64val[in[i + 1]];
+        const unsigned int c = (len & 3) == 3 ? b64val[in[i + 2]] : 0;
+
+        bad     |= a | b | c;
+        out[n++] = (unsigned char)((a << 2) | (b >> 4));
+        if ((len & 3) == 3) {
+            out[n++] = (unsigned char)((b << 4) | (c >> 2));
+        }
+    }
+
+    return (bad & 0x80) ? -1 : (int)n;
 }
 
 //------------------------------------------------------------------------------
 
-int Cmdb::parse(char *cmd) {
-    //Command
-    char cmdstr_buf [1 + MAX_CMD_LEN];
+bool Cmdb::convert(const CmdbTable &table, const parmdesc &desc, char *tok, unsigned int len, parm &val) {
+    //parms are not zeroed in advance, so all values are stored at full width.
+    switch (desc.typ) {
+        //Cardinal and Floating Point Types
+        case 'd' :
+        case 'i' :
+        case 'u' :
+        case 'o' :
+        case 'x' :
+        case 'e' :
+        case 'f' :
+        case 'g' :
+            val.type=(parmtype)desc.type;
+
+            return (*desc.conv)(tok, tok+len, val.val);         //No, incomplete or out of range conversion.
+
+        //String types
+        case 'c' :
+            val.type=PARM_CHAR;
+            val.val.ul=(unsigned char)tok[0];
+
+            return len==1;                                      //Incomplete conversion.
+
+        case 's' :
+            //A view of the token, terminated in place (it ends at a space or the end).
+            val.type=PARM_STRING;
+            val.len=len;
+            val.val.s=tok;
+            val.val.s[len]='\0';
+
+            return true;
+
+        //Enum types
+        case '{' : {
+            int v = table.symbol(desc, tok, len);
+
+            val.type=PARM_INT;
+            val.val.ul=v>0 ? v : 0;
+
+            return v>=0;                                        //Not one of the symbols.
+        }
+
+        //Blob types
+        case 'H' :
+        case 'B' : {
+            //Decoded in place, a view of the token.
+            int n = (desc.typ=='H') ? hex_decode(tok, len) : b64_decode(tok, len);
+
+            val.type=PARM_BLOB;
+            val.len=n>0 ? n : 0;
+            val.val.a=tok;
 
-    //Parameters
-    char argstr_buf [1 + MAX_CMD_LEN];
-    char *argsep;
+            return n>=0;                                        //Invalid digit or length.
+        }
 
-    char prmstr_buf [1 + MAX_CMD_LEN];                          //copy of sscanf pattern
-    char *tok;                                                  //current token
-    void *toks[MAX_ARGS];                                       //pointers to string tokens IN commandline (argstr_buf)
-    char *prms[MAX_ARGS];                                       //patterns IN copy of sscanf string (*parms)
+        default :
+            val.type=PARM_UNUSED;
 
-    char typ = '\0';                                            //Var type
-    char mod = '\0';                                            //Var modifier      (for cardinal types)
-    unsigned int base;                                          //Var number base (8,10,16)
-    //unsigned int bytes;                                       //Var size in bytes (used for malloc)
+            return true;
+    }
+}
 
-    float f;                                                    //Temp var for conversion, 4 bytes
-    //unsigned char b;                                          //Temp var for conversion, 1 byte
-    //char c;                                                    //Temp var for conversion, 1 byte
-    //short h;                                                  //Temp var for conversion, 2 bytes
-    //int k;                                                    //Temp var for conversion, 2 bytes
-    long l;                                                     //Temp var for conversion, 4 bytes
+int Cmdb::parse(char *cmd) {
+    span toks[MAX_ARGS];                                        //spans of the parameters IN commandline (cmd)
+    const parmdesc *sig;                                        //pre-compiled parameter signature (table->entry(ndx).parms)
 
-    char* endptr;                                               //strtoXX() Error detection
+    unsigned int pos;                                           //position in cmd
+    unsigned int have  = 0;                                     //parameters given on the commandline (bit per parameter)
+    unsigned int extra = 0;                                     //surplus or repeated tokens
 
     int cid = -1;                                               //Signals empty string...
     int ndx = -1;
@@ -496,270 +3040,129 @@ int Cmdb::parse(char *cmd) {
     argcnt=0;
     error =0;
 
-    //Zero the two string buffers for splitting cmd string into.
-    zeromemory((char*)cmdstr_buf,sizeof(cmdstr_buf));
-    zeromemory(argstr_buf,sizeof(argstr_buf));
-
-    //Make it worse in Lint
-    for (int i=0; i<MAX_ARGS; i++) {
-        parms[i].type=PARM_UNUSED;
-        zeromemory((char*)&(parms[i].val),sizeof(parms[i].val));
-    }
-
     /*------------------------------------------------
-    First, copy the command and convert it to all
-    uppercase.
-    ------------------------------------------------*/
-
-    strncpy(cmdstr_buf, cmd, sizeof (cmdstr_buf) - 1);
-    cmdstr_buf [sizeof (cmdstr_buf) - 1] = '\0';
-
-    /*------------------------------------------------
-    Next, find the end of the first thing in the
+    First, find the end of the first thing in the
     buffer.  Since the command ends with a space,
-    we'll look for that.  NULL-Terminate the command
-    and keep a pointer to the arguments.
+    we'll look for that. Nothing is copied, the
+    command and arguments are spans into cmd.
     ------------------------------------------------*/
 
-    argsep = strchr(cmdstr_buf, ' ');
-
-    if (argsep == NULL) {
-        argstr_buf [0] = '\0';
-    } else {
-        strcpy (argstr_buf, argsep + 1);
-        *argsep = '\0';
-    }
+    for (pos=0; cmd[pos] && cmd[pos]!=' '; pos++);
 
     /*------------------------------------------------
     Search for a command ID, then switch on it.
     ------------------------------------------------*/
 
     //1) Find the Command Id
-    cid = cmdid_search(cmdstr_buf);
+    cid = cmdid_search(cmd, pos);
 
     if (cid!=CID_LAST) {
-        //2) Tokenize a copy of the parms from the cmd_tbl.
+        //2) Lookup the parameter signature compiled by the CmdbTable.
 
         ndx = cmdid_index(cid);
 
-        //Get Format patterns from cmd_tbl[id].parms.
-        //note: strtok inserts \0 into the original string. Hence the copy.
-        zeromemory((char *)(&prmstr_buf),sizeof(prmstr_buf));
-
-        strncpy (prmstr_buf, cmds[ndx].parms, sizeof (prmstr_buf) - 1);
+        sig    = table->signature(ndx);
+        argcnt = table->argc(ndx);
 
-        argcnt=0;
-        tok = strtok(prmstr_buf, " ");
-        while (tok != NULL) {
-            //Store Pointers
-            prms[argcnt++] = tok;
+        int named = table->named(ndx);                          //positional parameters come first
+        int next  = 0;                                          //next positional parameter
 
-            //printf("prm_%2.2d='%s'\r\n",argcnt, tok);
+        //3) Tokenize the commandline, tokens go to the next positional parameter unless they are key=value.
 
-            tok = strtok(NULL, " ");
-        }
-
-        //3) Tokenize the commandline.
-
-        //Get Tokens from arguments.
-        //Note: strtok inserts \0 into the original string. Won't harm here as we do not re-use it.
-
-        argfnd=0;
-
-        if (strlen(argstr_buf)!=0) {
-            tok = strtok(argstr_buf, " ");
-        } else {
-            tok=NULL;
-        }
-
-        while (tok != NULL) {
-            //Store Pointers
-            toks[argfnd++]=tok;
-
-            //printf("tok_%2.2d='%s'\r\n",argfnd, tok);
-
-            tok = strtok(NULL, " ");
-        }
-
-        if (argfnd==argcnt || (cid==CID_HELP && argfnd==0)) {
+        while (cmd[pos]) {
+            //Skip separators.
+            while (cmd[pos]==' ') {
+                pos++;
+            }
 
-            error = 0;
+            if (!cmd[pos]) {
+                break;
+            }
 
-            for (int i=0; i<argcnt; i++) {
-                //printf("prm_%2.2d=%s\r\n",i, prms[i]);
+            unsigned int ofs = pos;
+            int i = -1;
 
-                switch (strlen(prms[i])) {
-                    case 0:
-                        break;
-                    case 1:
-                        break;
-                    case 2: //Simple pattern, no modifier
-                        mod='\0';
-                        typ=prms[i][1];
+            if (next<named && sig[next].type==PARM_ARRAY) {
+                //An array (always the last pattern) takes the rest of the line.
+                pos += strlen(cmd + pos);
+                i = next++;
+            } else {
+                while (cmd[pos] && cmd[pos]!=' ') {
+                    pos++;
+                }
 
-                        break;
-                    case 3: //pattern with Modifier.
-                        mod=prms[i][1];
-                        typ=prms[i][2];
+                //Named parameters are resolved by the key hash of the command.
+                const char *eq = named<argcnt ? (const char *)memchr(cmd + ofs, '=', pos - ofs) : NULL;
 
-                        break;
-                    default:
-                        break;
+                if (eq) {
+                    i = table->keyword(ndx, cmd + ofs, eq - (cmd + ofs));
                 }
 
-                switch (typ) {
-                    case 'o' :
-                        base=8;
-                        break;
-                    case 'x' :
-                        base=16;
-                        break;
-                    default:
-                        base=10;
-                        break;
+                if (i>=0) {
+                    ofs = eq + 1 - cmd;
+                } else if (next<named) {
+                    i = next++;
                 }
+            }
 
-                endptr = (char*)toks[i];
-
-                switch (typ) {
-                    //Signed Cardinal Types
-                    case 'd' :  //Check mod
-                    case 'i' :  //Check mod
-                        switch (mod) {
-                            case 'b' : //char
-                                //test range
-                                l=strtol((char*)toks[i], &endptr, base);
-                                if (l>=MIN_CHAR && l<=MAX_CHAR) {
-                                    parms[i].type=PARM_CHAR;
-                                    parms[i].val.uc =(unsigned char)l;
-                                } else {
-                                    error = i+1;
-                                }
-
-                                break;
-                            case 'h' : //short
-                                l=strtol((char*)toks[i], &endptr, base);
-                                if (l>=MIN_SHORT && l<=MAX_SHORT) {
-                                    parms[i].type=PARM_SHORT;
-                                    parms[i].val.w=(short)l;
-                                } else {
-                                    error = i+1;
-                                }
-
-                                break;
-                            case 'l' : //long
-                                l=strtol((char*)toks[i], &endptr, base);
-                                parms[i].type=PARM_LONG;
-                                parms[i].val.l=l;
+            if (i<0 || (have & (1u << i))) {
+                extra++;
+                continue;
+            }
 
-                                break;
-                            default: //int
-                                l=strtol((char*)toks[i], &endptr, base);
-                                if (l>=MIN_INT && l<=MAX_INT) {
-                                    parms[i].type=PARM_INT;
-                                    parms[i].val.l=(int)l;
-                                } else {
-                                    error = i+1;
-                                }
-                                break;
-                        }
+            toks[i].ofs=ofs;
+            toks[i].len=pos-ofs;
+            have |= 1u << i;
+        }
 
-                        if (error==0 &&
-                                (endptr==toks[i]    //No Conversion at all.
-                                 || *endptr)) {       //Incomplete conversion.
-                            error = i+1;
-                        }
+        //4) Count the parameters, missing ones take their default and a missing array is empty.
+        for (int i=0; i<argcnt; i++) {
+            if (!(have & (1u << i)) && sig[i].type==PARM_ARRAY) {
+                toks[i].ofs=pos;
+                toks[i].len=0;
+                have |= 1u << i;
+            }
 
-                        break;
+            if ((have & (1u << i)) || sig[i].def) {
+                argfnd++;
+            }
+        }
 
-                    //Unsigned Cardinal Types
-                    case 'u' :  //Check mod
-                    case 'o' :  //Check mod
-                    case 'x' :  //Check mod
-                        switch (mod) {
-                            case 'b' : //char
-                                //test range
-                                l=strtol((char*)toks[i], &endptr, base);
-                                if (l>=MIN_BYTE && l<=MAX_BYTE) {
-                                    parms[i].type=PARM_CHAR;
-                                    parms[i].val.uc =(unsigned char)l;
-                                } else {
-                                    error = i+1;
-                                }
+        //Surplus tokens never match.
+        if (extra) {
+            argfnd = argcnt + extra;
+        }
 
-                                break;
-                            case 'h' : //short
-                                l=strtol((char*)toks[i], &endptr, base);
-                                if (l>=MIN_USHORT && l<=MAX_USHORT) {
-                                    parms[i].type=PARM_SHORT;
-                                    parms[i].val.w=(short)l;
-                                } else {
-                                    error = i+1;
-                                }
+        if (argfnd==argcnt || (cid==CID_HELP && argfnd==0)) {
 
-                                break;
-                            case 'l' : //long
-                                l=strtol((char*)toks[i], &endptr, base);
-                                parms[i].type=PARM_LONG;
-                                parms[i].val.l=l;
+            error = 0;
 
-                                break;
-                            default: //int
-                                l=strtol((char*)toks[i], &endptr, base);
-                                if (l>=MIN_UINT && l<=MAX_UINT) {
-                                    parms[i].type=PARM_INT;
-                                    parms[i].val.l=(int)l;
-                                } else {
-                                    error = i+1;
-                                }
-                                break;
-                        }
+            for (int i=0; i<argfnd; i++) {
+                char *tok        = cmd + toks[i].ofs;
+                unsigned int len = toks[i].len;
 
-                        if (error==0 &&
-                                (endptr==toks[i]    //No Conversion at all.
-                                 || *endptr)) {       //Incomplete conversion.
-                            error = i+1;
-                        }
+                if (!(have & (1u << i))) {
+                    parms[i] = table->fallback(sig[i]);
 
-                        break;
+                    continue;
                 }
 
-                //Floating Point Types
-                switch (typ) {
-                    case 'e' :
-                    case 'f' :
-                    case 'g' :
-                        f = strtod((char*)toks[i], &endptr);
+                if (sig[i].type==PARM_ARRAY) {
+                    int n = (*sig[i].aconv)(tok, tok+len, arraybuf, arraysize / sig[i].size);
 
-                        parms[i].type=PARM_FLOAT;
-                        parms[i].val.f=f;
+                    parms[i].type=PARM_ARRAY;
+                    parms[i].len=n>0 ? n : 0;
+                    parms[i].val.a=arraybuf;
 
-                        if (error==0 &&
-                                (endptr==toks[i]    //No Conversion at all.
-                                 || *endptr)) {       //Incomplete conversion.
-                            error = i;
-                        }
+                    if (n<0) {
+                        error = i+1;                            //No conversion or too many elements.
+                    }
 
-                        break;
+                    continue;
                 }
 
-                //String types
-                switch (typ) {
-                    case 'c' :
-                        parms[i].type=PARM_CHAR;
-                        parms[i].val.c=((char*)toks[i])[0];
-
-                        if (error==0 && strlen((char*)toks[i])!=1) {  //Incomplete conversion.
-                            error = i;
-                        }
-
-                        break;
-
-                    case 's' :
-                        parms[i].type=PARM_STRING;
-                        strncpy(parms[i].val.s,(char*)toks[i], strlen((char*)toks[i]));
-
-                        break;
+                if (!convert(*table, sig[i], tok, len, parms[i])) {
+                    error = i+1;
                 }
             }
         } else {
@@ -772,11 +3175,14 @@ int Cmdb::parse(char *cmd) {
 
 //------------------------------------------------------------------------------
 
-void  Cmdb::cmd_dispatcher(char *cmd) {
-    int  cid;
+bool  Cmdb::cmd_dispatcher(char *cmd) {
+    return cmd_execute(parse(cmd), cmd);
+}
+
+bool  Cmdb::cmd_execute(int cid, const char *cmd) {
     int  ndx;
+    bool ok = true;
 
-    cid = parse(cmd);
     ndx = cmdid_index(cid);
 
     if (cid!=-1) {
@@ -794,13 +3200,14 @@ void  Cmdb::cmd_dispatcher(char *cmd) {
 
         if (cid==CID_LAST) {
             print("Unknown command, type 'Help' for a list of available commands.\r\n");
+            ok = false;
         } else {
             //printf("cmds[%d]=%d [%s]\r\n",ndx, cid, cmds[ndx].cmdstr);
 
             //Test for more commandline than allowed too.
             //i.e. run 1 is wrong.
 
-            if (argcnt==0 && argfnd==0 && error==0 && ndx!=-1 && cmds[ndx].subs==SUBSYSTEM) {
+            if (argcnt==0 && argfnd==0 && error==0 && ndx!=-1 && table->entry(ndx).subs==SUBSYSTEM) {
                 //Handle all SubSystems.
                 subsystem=cid;
             } else if ( ((cid==CID_HELP) || (argcnt==argfnd)) && error==0 ) {
@@ -811,29 +3218,32 @@ void  Cmdb::cmd_dispatcher(char *cmd) {
 
                         //Define Macro from commandline
                     case CID_MACRO:
-                        macro_ptr=-1;
-
-                        zeromemory((char*)macro_buf, sizeof(macro_buf));
-                        strncpy(macro_buf, STRINGPARM(0), sizeof(macro_buf) - 1);
-
-                        //DEBUG
-                        printf("Macro=%s\r\n",macro_buf);
+                        if (cmd) {
+                            ok = macro_define();
+                        }
                         break;
 
                         //Run Macro
                     case CID_RUN:
-                        macro_ptr=0;
+                        ok = macro_run(STRINGPARM(0));
                         break;
 
                         //List Macro's
-                    case CID_MACROS:
+                    case CID_MACROS: {
                         print("[Macro]\r\n");
-                        if (macro_buf[0]!='\0') {
-                            printf("Value=%s\r\n",macro_buf);
-                        } else {
+                        if (macro_used==0) {
                             printf(";No Macro Defined\r\n");
                         }
+                        for (unsigned int pos=0; pos<macro_used; ) {
+                            const unsigned char *rec = &macro_arena[pos];
+                            unsigned short size;
+
+                            memcpy(&size, rec, sizeof(size));
+                            printf("%.*s=%.*s\r\n", rec[2], (const char *)rec + 4, rec[3], (const char *)rec + 4 + rec[2]);
+                            pos += size;
+                        }
                         break;
+                    }
 
 #endif //ENABLEMACROS
 
@@ -864,7 +3274,10 @@ void  Cmdb::cmd_dispatcher(char *cmd) {
 
                         //Warm Boot
                     case CID_BOOT:
+                        flush();
+#if defined(__MBED__)
                         mbed_reset();
+#endif
                         break;
 
                         //Sends an ANSI escape code to clear the screen.
@@ -881,7 +3294,8 @@ void  Cmdb::cmd_dispatcher(char *cmd) {
                     case CID_HELP: {
                         print("\r\n");
 
-                        if (argfnd>0) {
+                        //Surplus arguments are not converted by parse(), so only look up a single one.
+                        if (argfnd>0 && argfnd==argcnt) {
                             cid = cmdid_search(STRINGPARM(0));
                         } else {
                             cid=CID_LAST;
@@ -892,21 +3306,21 @@ void  Cmdb::cmd_dispatcher(char *cmd) {
                             //Help with a valid command as first parameter
                             ndx = cmdid_index(cid);
 
-                            switch (cmds[ndx].subs) {
+                            switch (table->entry(ndx).subs) {
                                 case SUBSYSTEM: { //Dump whole subsystem
-                                    printf("%s subsystem commands:\r\n\r\n",cmds[ndx].cmdstr);
+                                    printf("%s subsystem commands:\r\n\r\n",table->entry(ndx).cmdstr);
 
                                     //Count SubSystem Commands.
                                     int subcmds =0;
-                                    for (int i=0; i<cmds.size(); i++) {
-                                        if (cmds[i].subs==cid) {
+                                    for (int i=0; i<table->size(); i++) {
+                                        if (table->entry(i).subs==cid) {
                                             subcmds++;
                                         }
                                     }
 
                                     //Print SubSystem Commands.
-                                    for (int i=0; i<cmds.size()-1; i++) {
-                                        if (cmds[i].subs==cid) {
+                                    for (int i=0; i<table->size(); i++) {
+                                        if (table->entry(i).subs==cid) {
                                             subcmds--;
                                             if (subcmds!=0) {
                                                 cmd_help("",i,",\r\n");
@@ -925,9 +3339,9 @@ void  Cmdb::cmd_dispatcher(char *cmd) {
                                     break;
 
                                 default: {      //Dump one subsystem command
-                                    int sndx = cmdid_index(cmds[ndx].subs);
+                                    int sndx = cmdid_index(table->entry(ndx).subs);
 
-                                    printf("%s subsystem command:\r\n\r\n",cmds[sndx].cmdstr);
+                                    printf("%s subsystem command:\r\n\r\n",table->entry(sndx).cmdstr);
 
                                     cmd_help("Syntax: ",ndx,".\r\n");
                                 }
@@ -941,13 +3355,16 @@ void  Cmdb::cmd_dispatcher(char *cmd) {
                                 //Help
 
                                 //Dump Active Subsystem, Global & Other (dormant) Subsystems
-                                //-1 because we want comma's and for the last a .
-                                for (int i=0; i<cmds.size()-1; i++) {
-                                    if ((cmds[i].subs<0) || (cmds[i].subs==subsystem)) {
+                                //Help itself goes last because we want comma's and for the last a .
+                                //It is looked up by id, the built-ins may be appended after it.
+                                int help = cmdid_index(CID_HELP);
+
+                                for (int i=0; i<table->size(); i++) {
+                                    if (i!=help && ((table->entry(i).subs<0) || (table->entry(i).subs==subsystem))) {
                                         cmd_help("",i,",\r\n");
                                     }
                                 }
-                                cmd_help("",cmds.size()-1,".\r\n");
+                                cmd_help("",help,".\r\n");
                             }
                         }
                         print("\r\n");
@@ -955,12 +3372,52 @@ void  Cmdb::cmd_dispatcher(char *cmd) {
                     } //CID_HELP
 
                     default : {
-                        // Do a Call to the Application's Command Dispatcher.
-                        (*user_callback)(*this, cid);
+                        void (*handler)(Cmdb &) = table->entry(ndx).handler;
+
+                        if (macro_depth) {
+                            // Macro steps run to completion, in order.
+                            if (handler) {
+                                (*handler)(*this);
+                                break;
+                            }
+#if defined(CMDB_COROUTINES)
+                            if (co_callback) {
+                                CmdbTask task = (*co_callback)(*this, cid);
+
+                                while (!task.handle.done()) {
+                                    task.handle.resume();
+                                }
+                                break;
+                            }
+#endif
+                            (*user_callback)(*this, cid);
+                        } else if (executor && !pending) {
+                            // Queue it (scan() submits it), execute() calls the Application's Command Dispatcher.
+                            pendingcid     = cid;
+                            pendinghandler = handler;
+                            pending        = true;
+                        } else if (handler) {
+                            // Call the Command's own Handler.
+                            (*handler)(*this);
+#if defined(CMDB_COROUTINES)
+                        } else if (co_callback) {
+                            // Start the Application's Coroutine Dispatcher, keep it if it suspends.
+                            CmdbTask task = (*co_callback)(*this, cid);
+
+                            if (!task.handle.done()) {
+                                cotask = task.handle.address();
+                                task.handle = nullptr;
+                            }
+#endif
+                        } else {
+                            // Do a Call to the Application's Command Dispatcher.
+                            (*user_callback)(*this, cid);
+                        }
                     }
                 }
             } else {
                 cmd_help("Syntax: ",ndx,".\r\n");
+                ok = false;
             }
 
         }
@@ -968,6 +3425,300 @@ void  Cmdb::cmd_dispatcher(char *cmd) {
     } else {
         //cid==-1
     }
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+//----Macros (pre-compiled into macro_arena).
+//------------------------------------------------------------------------------
+
+int   Cmdb::macro_find(const char *name, unsigned int len) {
+    for (unsigned int pos=0; pos<macro_used; ) {
+        const unsigned char *rec = &macro_arena[pos];
+        unsigned short size;
+        unsigned int i;
+
+        memcpy(&size, rec, sizeof(size));
+
+        if (rec[2]==len) {
+            for (i=0; i<len && fold(rec[4 + i])==fold(name[i]); i++);
+
+            if (i==len) {
+                return pos;
+            }
+        }
+        pos += size;
+    }
+
+    return -1;
+}
+
+bool  Cmdb::macro_define() {
+    //Views into the commandline, parsing the steps reuses parms.
+    const char *name     = STRINGPARM(0);
+    const char *text     = STRINGPARM(1);
+    unsigned int namelen = STRINGLEN(0);
+    unsigned int textlen = STRINGLEN(1);
+
+    //Compile behind the existing macros, so a failed definition leaves the store untouched.
+    unsigned int pos   = macro_used;
+    unsigned int start = pos;
+    unsigned int steps = 0;
+    int stepspos;
+
+    //Both lengths are stored in a byte.
+    if (namelen > 255 || textlen > 255) {
+        print("Macro name/text too long.\r\n");
+        return false;
+    }
+
+    if (pos + 5 + namelen + textlen > MAX_MACRO_SIZE) {
+        print("Macro store full.\r\n");
+        return false;
+    }
+
+    macro_arena[pos + 2] = namelen;
+    macro_arena[pos + 3] = textlen;
+    memcpy(&macro_arena[pos + 4], name, namelen);
+    memcpy(&macro_arena[pos + 4 + namelen], text, textlen);
+    pos += 4 + namelen + textlen;
+    stepspos = pos++;
+
+    //Resolve the steps in the subsystem they will run in.
+    int saved = subsystem;
+    bool ok = true;
+
+    for (unsigned int i=0; i<textlen && ok; ) {
+        char step[1 + MAX_CMD_LEN];
+        unsigned int len = 0;
+
+        //Translate Special Characters Back
+        for (; i<textlen && text[i]!='|'; i++) {
+            step[len++] = text[i]=='_' ? sp : text[i];
+        }
+        step[len] = '\0';
+        i++;
+
+        if (len==0) {
+            continue;
+        }
+
+        int cid = parse(step);
+        int ndx = cmdid_index(cid);
+
+        if (cid==CID_LAST || cid==CID_MACRO || steps==255) {
+            ok = false;
+        } else if (argcnt==0 && argfnd==0 && table->entry(ndx).subs==SUBSYSTEM) {
+            subsystem = cid;
+        } else if (((cid==CID_HELP && argfnd==0) || (argcnt==argfnd)) && error==0) {
+            if (cid==CID_IDLE) {
+                subsystem = -1;
+            }
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            printf("Macro step %d is invalid.\r\n", steps + 1);
+            break;
+        }
+
+        //Append the step.
+        unsigned int need = sizeof(int) + 1;
+
+        const parmdesc *sig = table->signature(ndx);
+
+        for (int j=0; j<argfnd; j++) {
+            switch (parms[j].type) {
+                case PARM_STRING :
+                    need += 1 + sizeof(unsigned short) + parms[j].len + 1;
+                    break;
+                case PARM_BLOB :
+                    need += 1 + sizeof(unsigned short) + parms[j].len;
+                    break;
+                case PARM_ARRAY :
+                    need += 1 + sizeof(unsigned short) + 1 + parms[j].len * sig[j].size;
+                    break;
+                default :
+                    need += 1 + sizeof(unsigned long);
+                    break;
+            }
+        }
+
+        if (pos + need > MAX_MACRO_SIZE) {
+            print("Macro store full.\r\n");
+            ok = false;
+            break;
+        }
+
+        memcpy(&macro_arena[pos], &cid, sizeof(int));
+        pos += sizeof(int);
+        macro_arena[pos++] = argfnd;
+
+        for (int j=0; j<argfnd; j++) {
+            macro_arena[pos++] = parms[j].type;
+
+            if (parms[j].type==PARM_STRING) {
+                //Kept terminated, so Run can pass a view into the store.
+                memcpy(&macro_arena[pos], &parms[j].len, sizeof(unsigned short));
+                pos += sizeof(unsigned short);
+                memcpy(&macro_arena[pos], parms[j].val.s, parms[j].len + 1);
+                pos += parms[j].len + 1;
+            } else if (parms[j].type==PARM_BLOB) {
+                memcpy(&macro_arena[pos], &parms[j].len, sizeof(unsigned short));
+                pos += sizeof(unsigned short);
+                memcpy(&macro_arena[pos], parms[j].val.a, parms[j].len);
+                pos += parms[j].len;
+            } else if (parms[j].type==PARM_ARRAY) {
+                //Copied back into the array buffer by Run.
+                memcpy(&macro_arena[pos], &parms[j].len, sizeof(unsigned short));
+                pos += sizeof(unsigned short);
+                macro_arena[pos++] = sig[j].size;
+                memcpy(&macro_arena[pos], parms[j].val.a, parms[j].len * sig[j].size);
+                pos += parms[j].len * sig[j].size;
+            } else {
+                memcpy(&macro_arena[pos], &parms[j].val.ul, sizeof(unsigned long));
+                pos += sizeof(unsigned long);
+            }
+        }
+        steps++;
+    }
+
+    subsystem = saved;
+
+    if (!ok) {
+        return false;
+    }
+
+    unsigned short size = pos - start;
+
+    memcpy(&macro_arena[start], &size, sizeof(size));
+    macro_arena[stepspos] = steps;
+
+    //Replace a macro with the same name.
+    int old = macro_find(name, namelen);
+
+    if (old!=-1 && (unsigned int)old!=start) {
+        unsigned short oldsize;
+
+        memcpy(&oldsize, &macro_arena[old], sizeof(oldsize));
+        memmove(&macro_arena[old], &macro_arena[old + oldsize], pos - (old + oldsize));
+        pos -= oldsize;
+    }
+
+    macro_used = pos;
+
+    return true;
+}
+
+bool  Cmdb::macro_run(const char *name) {
+    int pos = macro_find(name, strlen(name));
+
+    if (pos==-1) {
+        print("Unknown macro.\r\n");
+        return false;
+    }
+
+    if (macro_depth==MAX_MACRO_DEPTH) {
+        print("Macros nested too deep.\r\n");
+        return false;
+    }
+
+    //Steps are dispatched directly, no echo and no re-scan.
+    const unsigned char *p = &macro_arena[pos];
+    unsigned int steps     = p[4 + p[2] + p[3]];
+    bool ok = true;
+
+    p += 5 + p[2] + p[3];
+
+    macro_depth++;
+    for (unsigned int i=0; i<steps && ok; i++) {
+        int cid;
+
+        memcpy(&cid, p, sizeof(int));
+        p += sizeof(int);
+
+        argfnd = argcnt = *p++;
+        error  = 0;
+
+        for (int j=0; j<argfnd; j++) {
+            parms[j].type = (parmtype)*p++;
+
+            if (parms[j].type==PARM_STRING) {
+                memcpy(&parms[j].len, p, sizeof(unsigned short));
+                p += sizeof(unsigned short);
+                parms[j].val.s = (char *)p;
+                p += parms[j].len + 1;
+            } else if (parms[j].type==PARM_BLOB) {
+                memcpy(&parms[j].len, p, sizeof(unsigned short));
+                p += sizeof(unsigned short);
+                parms[j].val.a = (void *)p;
+                p += parms[j].len;
+            } else if (parms[j].type==PARM_ARRAY) {
+                memcpy(&parms[j].len, p, sizeof(unsigned short));
+                p += sizeof(unsigned short);
+
+                unsigned int bytes = parms[j].len * *p++;
+
+                if (bytes > arraysize) {
+                    error = j+1;
+                } else if (bytes) {
+                    memcpy(arraybuf, p, bytes);
+                }
+                parms[j].val.a = arraybuf;
+                p += bytes;
+            } else {
+                memcpy(&parms[j].val.ul, p, sizeof(unsigned long));
+                p += sizeof(unsigned long);
+            }
+        }
+
+        ok = cmd_execute(cid, NULL);
+    }
+    macro_depth--;
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+
+void  Cmdb::cmd_batch() {
+    bool inexecute = pending;                       // Called by execute(), commands run inline.
+
+    while (batchpos != -1) {
+        char *cmd = &cmdbuf[batchpos];
+        char *sep = strchr(cmd, ';');
+
+        //Dispatch in place, the line is not needed afterwards.
+        if (sep) {
+            *sep     = '\0';
+            batchpos = (sep + 1) - cmdbuf;
+        } else {
+            batchpos = -1;
+        }
+
+        if (cmd != cmdbuf) {
+            while (*cmd == ' ') {                   // Skip the space after a ';'
+                cmd++;
+            }
+        }
+
+        if (!*cmd) {
+            continue;                               // Empty command
+        }
+
+        batchno++;
+
+        if (!cmd_dispatcher(cmd) && batchstop && batchpos != -1) {
+            printf("Command %d failed, the rest of the line is skipped.\r\n", batchno);
+            batchpos = -1;
+        }
+
+        if ((pending && !inexecute) || cotask) {
+            return;                                 // Continued by execute() or resume().
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -979,19 +3730,20 @@ void Cmdb::cmd_dump() {
     int  j;
     int  k;
     int  lastmod;
+    int  arg;                                                   //Parameter of parms[j].
 
     k = 0;
     lastmod = 0;
 
-    for (ndx=0; ndx<cmds.size(); ndx++) {
+    for (ndx=0; ndx<table->size(); ndx++) {
 
 #ifndef SHOWHIDDEN
-        if (cmds[ndx].subs==HIDDENSUB) {
+        if (table->entry(ndx).subs==HIDDENSUB) {
             continue;
         }
 #endif
 
-        switch (cmds[ndx].subs) {
+        switch (table->entry(ndx).subs) {
             case SUBSYSTEM :
                 printf("[command%2.2d]\r\n",ndx+1);
                 print("type=Subsystem\r\n");
@@ -1010,9 +3762,9 @@ void Cmdb::cmd_dump() {
                 print("subsystem=Global\r\n");
                 break;
             default        :
-                int sndx = cmdid_index(cmds[ndx].subs);
+                int sndx = cmdid_index(table->entry(ndx).subs);
 
-                if (cmds[sndx].subs==HIDDENSUB) {
+                if (table->entry(sndx).subs==HIDDENSUB) {
 #ifdef SHOWHIDDEN
                     printf("[command%2.2d]\r\n",ndx+1);
                     print("type=HiddenCommand\r\n");
@@ -1023,22 +3775,59 @@ void Cmdb::cmd_dump() {
 
                 printf("[command%2.2d]\r\n",ndx+1);
                 print("type=Command\r\n");
-                printf("subsystem=%s\r\n",cmds[sndx].cmdstr);
+                printf("subsystem=%s\r\n",table->entry(sndx).cmdstr);
         }
 
-        if (cmds[ndx].subs==HIDDENSUB) {
+        if (table->entry(ndx).subs==HIDDENSUB) {
             continue;
         }
 
-        printf("command=%s\r\n",cmds[ndx].cmdstr);
-        printf("helpmsg=%s\r\n",cmds[ndx].cmddescr);
+        printf("command=%s\r\n",table->entry(ndx).cmdstr);
+        printf("helpmsg=%s\r\n",table->entry(ndx).cmddescr);
         print("parameters=");
-        for (j=0; j<strlen(cmds[ndx].parms); j++) {
-            switch (cmds[ndx].parms[j]) {
+        arg=-1;
+        for (j=0; j<strlen(table->entry(ndx).parms); j++) {
+            if ((j==0 || table->entry(ndx).parms[j-1]==' ') && table->entry(ndx).parms[j]!=' ') {
+                arg++;
+            }
+
+            //The key of a named parameter (up to the %).
+            if ((j==0 || table->entry(ndx).parms[j-1]==' ') && !strchr("% ", table->entry(ndx).parms[j])) {
+                int n = strcspn(&table->entry(ndx).parms[j], "% ");
+
+                printf("%.*s", n, &table->entry(ndx).parms[j]);
+                k+=n;
+                j+=n-1;
+                continue;
+            }
+
+            switch (table->entry(ndx).parms[j]) {
                 case '%' :
                     lastmod=0;
                     break;
 
+                case '=' : {
+                    //Default value (unless CmdbTable could not convert it).
+                    int n = strcspn(&table->entry(ndx).parms[j], " ");
+
+                    if (arg<table->argc(ndx) && table->signature(ndx)[arg].def) {
+                        printf("%.*s", n, &table->entry(ndx).parms[j]);
+                        k+=n;
+                    }
+                    j+=n-1;
+                    break;
+                }
+
+                case '{' : {
+                    //Enum, list its symbols.
+                    int n = strcspn(&table->entry(ndx).parms[j], "}") + 1;
+
+                    printf("%.*s", n, &table->entry(ndx).parms[j]);
+                    k+=n;
+                    j+=n-1;
+                    break;
+                }
+
                 case 'b' :
                     lastmod=8;
                     break;
@@ -1088,7 +3877,7 @@ void Cmdb::cmd_dump() {
                             break;
                     }
 
-                    switch (cmds[ndx].parms[j]) {
+                    switch (table->entry(ndx).parms[j]) {
                         case 'o' :
                             print("[o]");
                             k+=3;
@@ -1119,14 +3908,27 @@ void Cmdb::cmd_dump() {
                     k+=6;
                     break;
 
+                case 'H' :
+                    print("hex");
+                    k+=3;
+                    break;
+
+                case 'B' :
+                    print("base64");
+                    k+=6;
+                    break;
+
                 case ' ' :
                     printch(sp);
                     k++;
                     break;
             }
         }
+        if (strchr(table->entry(ndx).parms, '*')) {
+            print("...");
+        }
         print("\r\n");
-        printf("syntax=%s\r\n",cmds[ndx].parmdescr);
+        printf("syntax=%s\r\n",table->entry(ndx).parmdescr);
     }
 }
 
@@ -1135,24 +3937,30 @@ void  Cmdb::prompt(void) {
     if (subsystem!=-1) {
         int ndx = cmdid_index(subsystem);
 
-        printf("%s>",cmds[ndx].cmdstr);
+        printf("%s>",table->entry(ndx).cmdstr);
+
+        flush();
 
         return;
     }
 #endif //SUBSYSTEMPROMPTS
 
-    printf(PROMPT);
+    print(PROMPT);
+
+    flush();
 }
 
 void  Cmdb::cmd_help(char *pre, int ndx, char *post) {
     int  j;
     int  k;
     int  lastmod;
+    int  arg;                                                   //Parameter of parms[j].
 
     k=0;
     lastmod=0;
+    arg=-1;
 
-    switch (cmds[ndx].subs) {
+    switch (table->entry(ndx).subs) {
         case SUBSYSTEM :
             break;
         case GLOBALCMD :
@@ -1170,32 +3978,68 @@ void  Cmdb::cmd_help(char *pre, int ndx, char *post) {
     k+=strlen(pre);
 
     if (k==0) {
-        printf("%12s",cmds[ndx].cmdstr);
+        printf("%12s",table->entry(ndx).cmdstr);
         k+=12;
     } else {
         if (strlen(pre)>0 && bold) {
             print(boldon);
         }
 
-        printf("%s",cmds[ndx].cmdstr);
-        k+=strlen(cmds[ndx].cmdstr);
+        printf("%s",table->entry(ndx).cmdstr);
+        k+=strlen(table->entry(ndx).cmdstr);
 
         if (strlen(pre)>0 && bold) {
             print(boldoff);
         }
     }
 
-    if (strlen(cmds[ndx].parms)) {
+    if (strlen(table->entry(ndx).parms)) {
         printch(sp);
         k++;
     }
 
-    for (j=0; j<strlen(cmds[ndx].parms); j++) {
-        switch (cmds[ndx].parms[j]) {
+    for (j=0; j<strlen(table->entry(ndx).parms); j++) {
+        if ((j==0 || table->entry(ndx).parms[j-1]==' ') && table->entry(ndx).parms[j]!=' ') {
+            arg++;
+        }
+
+        //The key of a named parameter (up to the %).
+        if ((j==0 || table->entry(ndx).parms[j-1]==' ') && !strchr("% ", table->entry(ndx).parms[j])) {
+            int n = strcspn(&table->entry(ndx).parms[j], "% ");
+
+            printf("%.*s", n, &table->entry(ndx).parms[j]);
+            k+=n;
+            j+=n-1;
+            continue;
+        }
+
+        switch (table->entry(ndx).parms[j]) {
             case '%' :
                 lastmod=0;
                 break;
 
+            case '=' : {
+                //Default value (unless CmdbTable could not convert it).
+                int n = strcspn(&table->entry(ndx).parms[j], " ");
+
+                if (arg<table->argc(ndx) && table->signature(ndx)[arg].def) {
+                    printf("%.*s", n, &table->entry(ndx).parms[j]);
+                    k+=n;
+                }
+                j+=n-1;
+                break;
+            }
+
+            case '{' : {
+                //Enum, list its symbols.
+                int n = strcspn(&table->entry(ndx).parms[j], "}") + 1;
+
+                printf("%.*s", n, &table->entry(ndx).parms[j]);
+                k+=n;
+                j+=n-1;
+                break;
+            }
+
             case 'b' :
                 lastmod=8;
                 break;
@@ -1245,7 +4089,7 @@ void  Cmdb::cmd_help(char *pre, int ndx, char *post) {
                         break;
                 }
 
-                switch (cmds[ndx].parms[j]) {
+                switch (table->entry(ndx).parms[j]) {
                     case 'o' :
                         print("[o]");
                         k+=3;
@@ -1276,6 +4120,16 @@ void  Cmdb::cmd_help(char *pre, int ndx, char *post) {
                 k+=6;
                 break;
 
+            case 'H' :
+                print("hex");
+                k+=3;
+                break;
+
+            case 'B' :
+                print("base64");
+                k+=6;
+                break;
+
             case ' ' :
                 printch(sp);
                 k++;
@@ -1283,31 +4137,37 @@ void  Cmdb::cmd_help(char *pre, int ndx, char *post) {
         }
     }
 
+    //An array takes any number of values.
+    if (strchr(table->entry(ndx).parms, '*')) {
+        print("...");
+        k+=3;
+    }
+
     for (j=k; j<40; j++) printch(sp);
 
-    switch (cmds[ndx].subs) {
+    switch (table->entry(ndx).subs) {
         case SUBSYSTEM :
             if (ndx==subsystem) {
-                printf("- %s (active subsystem)%s",cmds[ndx].cmddescr,post);
+                printf("- %s (active subsystem)%s",table->entry(ndx).cmddescr,post);
             } else {
-                printf("- %s (dormant subsystem)%s",cmds[ndx].cmddescr,post);
+                printf("- %s (dormant subsystem)%s",table->entry(ndx).cmddescr,post);
             }
             break;
         case HIDDENSUB :
             break;
         case GLOBALCMD :
-            printf("- %s (global command)%s",cmds[ndx].cmddescr,post);
+            printf("- %s (global command)%s",table->entry(ndx).cmddescr,post);
             break;
         default        :
-            printf("- %s%s",cmds[ndx].cmddescr,post);
+            printf("- %s%s",table->entry(ndx).cmddescr,post);
             if (strlen(pre)==0 && bold) {
                 print(boldoff);
             }
             break;
     }
 
-    if (strlen(pre)>0 && strlen(cmds[ndx].parmdescr)) {
-        printf("Params: %s",cmds[ndx].parmdescr);
+    if (strlen(pre)>0 && strlen(table->entry(ndx).parmdescr)) {
+        printf("Params: %s",table->entry(ndx).parmdescr);
         print("\r\n");
     }
 }
@@ -23,10 +23,31 @@
 #ifndef MBED_CMDB_H
 #define MBED_CMDB_H
 
+#if defined(__MBED__)
 #include "mbed.h"
+#endif
 
 #include <vector>
+#include <string>
 #include <limits>
+#include <string.h>
+#include <stdarg.h>
+
+#if __cplusplus >= 201103L
+#include <atomic>
+#endif
+
+#if __cplusplus >= 201402L
+#include <utility>
+#endif
+
+/** Defined if command handlers can be coroutines (C++20, see Cmdb::coroutines()).
+ */
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define CMDB_COROUTINES
+#include <coroutine>
+#include <exception>
+#endif
 
 //------------------------------------------------------------------------------
 
@@ -34,17 +55,32 @@
  */
 #define MAX_ESC_LEN 5
 
-/** Max (strlen) of a Param.
- */
-#define MAX_PARM_LEN 32
-
 /** Max eight parms.
  */
 #define MAX_ARGS 8
 
-/** Max 132 characters commandline.
+/** Max 132 characters commandline (may be overridden, up to 65535).
  */
+#ifndef MAX_CMD_LEN
 #define MAX_CMD_LEN 132
+#endif
+
+/** Size of the output buffer.
+ *
+ * All output is collected in this buffer and written to the serial port
+ * at the prompt, when full, after each scan() or when flush() is called.
+ */
+#ifndef MAX_TX_LEN
+#define MAX_TX_LEN 128
+#endif
+
+/** Size of the receive buffer used after Cmdb::attach().
+ *
+ * Must be a power of two.
+ */
+#ifndef MAX_RX_LEN
+#define MAX_RX_LEN 64
+#endif
 
 /** 'Show' hidden subsystems and commands.
  */
@@ -54,6 +90,18 @@
  */
 #define ENABLEMACROS
 
+/** Size of the (pre-compiled) macro store.
+ */
+#ifndef MAX_MACRO_SIZE
+#define MAX_MACRO_SIZE 512
+#endif
+
+/** Max nesting of macros running macros.
+ */
+#ifndef MAX_MACRO_DEPTH
+#define MAX_MACRO_DEPTH 4
+#endif
+
 /** Enable statemachine.
  *
  * Used to implement a series of commands running at power-up.
@@ -141,7 +189,62 @@
 
 //------------------------------------------------------------------------------
 
+/** Lets the compiler check printf style format strings against their arguments.
+ *
+ * @param fmt the (1 based, this counts as 1) index of the format parameter.
+ * @param args the index of the first variable argument.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define CMDB_PRINTF(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define CMDB_PRINTF(fmt, args)
+#endif
+
+/** Marks functions that can be evaluated at compile time (C++11 and up).
+ */
+#if __cplusplus >= 201103L
+#define CMDB_CONSTEXPR constexpr
+#else
+#define CMDB_CONSTEXPR
+#endif
+
+/** FNV-1a offset basis (command name hashes).
+ */
+#define FNV_BASIS 2166136261u
+
+/** FNV-1a prime.
+ */
+#define FNV_PRIME 16777619u
+
+/** Xor-shift step of cmdb_mix().
+ */
+static CMDB_CONSTEXPR inline unsigned int cmdb_xs(unsigned int x, unsigned int s)
+{
+    return (x ^ (x >> s)) & 0xFFFFFFFFu;
+}
+
+/** Mixes a (name or cid) hash with a seed into a bits wide slot number.
+ *
+ * Used by the perfect hashes of CmdbIndex (MurmurHash3 finalizer).
+ */
+static CMDB_CONSTEXPR inline unsigned int cmdb_mix(unsigned int hash, unsigned int seed, unsigned int bits)
+{
+    return cmdb_xs((cmdb_xs((cmdb_xs((hash ^ (seed * 0x9E3779B9u)) & 0xFFFFFFFFu, 16) * 0x85EBCA6Bu) & 0xFFFFFFFFu, 13) * 0xC2B2AE35u) & 0xFFFFFFFFu, 16) >> (32 - bits);
+}
+
+//------------------------------------------------------------------------------
+
+class Cmdb;
+
 /** Description of a command.
+ *
+ * handler is optional, commands without one go to the callback of Cmdb.
+ * See CMDB_CMD() for handlers with typed parameters.
+ *
+ * parms holds space separated patterns like %i, %*d or %{on|off}. A pattern
+ * like %i=10 has a default and may be left out (trailing parameters only),
+ * a pattern like baud=%i=9600 is named and given as baud=115200 in any order
+ * after the positional ones. Named parameters without a default are required.
  */
 struct cmd
 {
@@ -152,6 +255,7 @@ public:
     const char *parms;
     const char *cmddescr;
     const char *parmdescr;
+    void (*handler)(Cmdb &);
 };
 
 //------------------------------------------------------------------------------
@@ -228,19 +332,20 @@ static const char PROMPT[] = "CMD>";
 
 /** Predefined Macro Command.
  *
- * This command will take a string with spaces replace by _ and cr replace by | for later replay with run.
+ * This command will take a name and a string with spaces replace by _ and cr replace by | for later replay with run.
+ * The commands are looked up and their parameters converted when the macro is defined.
  */
 #define CID_MACRO 9991
 
 /** Predefined Macro Command.
  *
- * This command replay a macro.
+ * This command replay a macro by name.
  */
 #define CID_RUN 9992
 
 /** Predefined Macro Command.
  *
- * This command print the current macro.
+ * This command print the defined macros.
  */
 #define CID_MACROS 9993
 
@@ -289,61 +394,61 @@ static const char PROMPT[] = "CMD>";
  *
  * Optional.
  */
-static const cmd COMMANDS = {"Commands", GLOBALCMD, CID_COMMANDS, "", "Dump Commands"};
+static const cmd COMMANDS = {"Commands", GLOBALCMD, CID_COMMANDS, "", "Dump Commands", "", NULL};
 
 /** The Boot Command.
  *
  * Optional.
  */
-static const cmd BOOT = {"Boot", GLOBALCMD, CID_BOOT, "", "Boot mBed"};
+static const cmd BOOT = {"Boot", GLOBALCMD, CID_BOOT, "", "Boot mBed", "", NULL};
 
 /** The Macro Command.
  *
  * Optional.
  */
-static const cmd MACRO = {"Macro", GLOBALCMD, CID_MACRO, "%s", "Define macro (sp->_, cr->|)", "command(s)"};
+static const cmd MACRO = {"Macro", GLOBALCMD, CID_MACRO, "%s %s", "Define macro (sp->_, cr->|)", "name command(s)", NULL};
 
 /** The Run Command.
  *
  * Optional.
  */
-static const cmd RUN = {"Run", GLOBALCMD, CID_RUN, "", "Run a macro"};
+static const cmd RUN = {"Run", GLOBALCMD, CID_RUN, "%s", "Run a macro", "name", NULL};
 
 /** The Macros Command.
  *
  * Optional.
  */
-static const cmd MACROS = {"Macros", GLOBALCMD, CID_MACROS, "", "List macro(s)"};
+static const cmd MACROS = {"Macros", GLOBALCMD, CID_MACROS, "", "List macro(s)", "", NULL};
 
 /** The Echo Command.
  *
  * Optional.
  */
-static const cmd ECHO = {"Echo", GLOBALCMD, CID_ECHO, "%bu", "Echo On|Off (1|0)", "state"};
+static const cmd ECHO = {"Echo", GLOBALCMD, CID_ECHO, "%bu", "Echo On|Off (1|0)", "state", NULL};
 
 /** The Bold Command.
  *
  * Optional.
  */
-static const cmd BOLD = {"Bold", GLOBALCMD, CID_BOLD, "%bu", "Bold On|Off (1|0)", "state"};
+static const cmd BOLD = {"Bold", GLOBALCMD, CID_BOLD, "%bu", "Bold On|Off (1|0)", "state", NULL};
 
 /** The Cls Command.
  *
  * Optional.
  */
-static const cmd CLS = {"Cls", GLOBALCMD, CID_CLS, "", "Clears the terminal screen"};
+static const cmd CLS = {"Cls", GLOBALCMD, CID_CLS, "", "Clears the terminal screen", "", NULL};
 
 /** The Idle Command.
  *
  * Mandatory if you use subsystems.
  */
-static const cmd IDLE = {"Idle", GLOBALCMD, CID_IDLE, "", "Deselect Subsystems"};
+static const cmd IDLE = {"Idle", GLOBALCMD, CID_IDLE, "", "Deselect Subsystems", "", NULL};
 
 /** The Help Command.
  *
  * Mandatory.
  */
-static const cmd HELP = {"Help", GLOBALCMD, CID_HELP, "%s", "Help"};
+static const cmd HELP = {"Help", GLOBALCMD, CID_HELP, "%s", "Help", "", NULL};
 
 //------------------------------------------------------------------------------
 
@@ -387,6 +492,314 @@ static const struct esc esc_tbl[ESC_TBL_LEN] = {
 
 //------------------------------------------------------------------------------
 
+/** Transport used by Cmdb for all input and output.
+ *
+ * Only bulk operations are virtual, so the call overhead is paid once per
+ * output buffer (see flush()) or received block, not per character.
+ *
+ * @see CmdbSerial, CmdbFd, CmdbMemory and CmdbPort.
+ */
+class CmdbTransport
+{
+public:
+    virtual ~CmdbTransport() {}
+
+    /** Checks if there are characters waiting to be read.
+     *
+     * @returns the number of characters available (or just 1 if unknown), 0 if none.
+     */
+    virtual int readable() = 0;
+
+    /** Reads up to len characters.
+     *
+     * Only blocks when no character is available.
+     *
+     * @param buf where to store the characters.
+     * @param len the size of buf.
+     *
+     * @returns the number of characters read, 0 at end of input or -1 on error.
+     */
+    virtual int read(char *buf, unsigned int len) = 0;
+
+    /** Writes len characters (embedded NULL's included).
+     *
+     * @param buf the characters to write.
+     * @param len the number of characters.
+     *
+     * @returns the number of characters written or -1 on error.
+     */
+    virtual int write(const char *buf, unsigned int len) = 0;
+
+    /** Attaches a receive interrupt handler (see Cmdb::attach()).
+     *
+     * @param handler the function to call from the interrupt.
+     * @param context the parameter passed to handler.
+     *
+     * @returns false if the transport has no receive interrupt.
+     */
+    virtual bool attach(void (*handler)(void *), void *context)
+    {
+        (void)handler;
+        (void)context;
+
+        return false;
+    }
+};
+
+/** Adapts any class with matching readable(), read() and write() members
+ * to a CmdbTransport.
+ *
+ * The calls to T are resolved at compile time (and inlined where possible).
+ *
+ * Usage: CmdbPort<MyUart> port(uart); Cmdb cmdb(&port, cmds, dispatch);
+ */
+template <typename T>
+class CmdbPort : public CmdbTransport
+{
+public:
+    CmdbPort(T &_port) : port(_port) {}
+
+    virtual int readable()
+    {
+        return port.readable();
+    }
+
+    virtual int read(char *buf, unsigned int len)
+    {
+        return port.read(buf, len);
+    }
+
+    virtual int write(const char *buf, unsigned int len)
+    {
+        return port.write(buf, len);
+    }
+
+private:
+    T &port;
+};
+
+#if defined(__MBED__)
+/** Transport for a mbed RawSerial port.
+ */
+class CmdbSerial : public CmdbTransport
+{
+public:
+    CmdbSerial(RawSerial *_serial = NULL) : serial(_serial), handler(NULL), context(NULL) {}
+
+    virtual int readable();
+
+    virtual int read(char *buf, unsigned int len);
+
+    virtual int write(const char *buf, unsigned int len);
+
+    virtual bool attach(void (*_handler)(void *), void *_context);
+
+private:
+    /** RxIrq handler, forwards to handler.
+     */
+    void irq();
+
+    RawSerial *serial;
+
+    void (*handler)(void *);
+    void *context;
+};
+#endif
+
+#if defined(__unix__)
+/** Transport for a file descriptor (pipe, PTY, socket, etc).
+ *
+ * Usage: CmdbFd io(STDIN_FILENO, STDOUT_FILENO);
+ */
+class CmdbFd : public CmdbTransport
+{
+public:
+    CmdbFd(int _in, int _out) : in(_in), out(_out), ended(false) {}
+
+    virtual int readable();
+
+    virtual int read(char *buf, unsigned int len);
+
+    virtual int write(const char *buf, unsigned int len);
+
+    /** True after read() hit end of input (or an error).
+     */
+    bool eof()
+    {
+        return ended;
+    }
+
+private:
+    int in;
+    int out;
+    bool ended;
+};
+#endif
+
+/** In-memory transport, reads from a buffer and collects all output.
+ *
+ * Used for testing and benchmarking on a host.
+ */
+class CmdbMemory : public CmdbTransport
+{
+public:
+    CmdbMemory() : input(NULL), inlen(0), inpos(0) {}
+
+    /** Sets the characters to be read (not copied).
+     */
+    void feed(const char *buf, unsigned int len)
+    {
+        input = buf;
+        inlen = len;
+        inpos = 0;
+    }
+
+    virtual int readable()
+    {
+        return inlen - inpos;
+    }
+
+    virtual int read(char *buf, unsigned int len)
+    {
+        if (len > inlen - inpos) {
+            len = inlen - inpos;
+        }
+        memcpy(buf, input + inpos, len);
+        inpos += len;
+
+        return len;
+    }
+
+    virtual int write(const char *buf, unsigned int len)
+    {
+        output.append(buf, len);
+
+        return len;
+    }
+
+    /** All characters written so far.
+     */
+    std::string output;
+
+private:
+    const char *input;
+    unsigned int inlen;
+    unsigned int inpos;
+};
+
+//------------------------------------------------------------------------------
+
+class CmdbTable;
+class Cmdb;
+struct CmdbTask;
+
+#if defined(CMDB_COROUTINES)
+/** Return type of coroutine command handlers (see Cmdb::coroutines()).
+ *
+ * The handler runs inside scan() up to its first co_await and is resumed by Cmdb::resume().
+ *
+ * Usage: CmdbTask sweep(Cmdb &cmdb, int cid) { for (...) { ...; co_await CmdbYield(); } }
+ */
+struct CmdbTask
+{
+    struct promise_type
+    {
+        CmdbTask get_return_object()
+        {
+            return CmdbTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return std::suspend_never();
+        }
+
+        //Suspended when finished, so Cmdb sees done() before it destroys the frame.
+        std::suspend_always final_suspend() noexcept
+        {
+            return std::suspend_always();
+        }
+
+        void return_void() {}
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    explicit CmdbTask(std::coroutine_handle<promise_type> _handle) : handle(_handle) {}
+
+    CmdbTask(CmdbTask &&other) noexcept : handle(other.handle)
+    {
+        other.handle = nullptr;
+    }
+
+    ~CmdbTask()
+    {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/** Suspends a coroutine command handler until the next Cmdb::resume() (co_await CmdbYield();).
+ */
+typedef std::suspend_always CmdbYield;
+#endif
+
+/** A view of an array parameter (see Cmdb::ARRAYPARM()).
+ */
+template <typename T>
+struct CmdbSpan
+{
+    T *ptr;
+    unsigned int len;
+
+    T *data() const
+    {
+        return ptr;
+    }
+
+    unsigned int size() const
+    {
+        return len;
+    }
+
+    T *begin() const
+    {
+        return ptr;
+    }
+
+    T *end() const
+    {
+        return ptr + len;
+    }
+
+    T &operator[](unsigned int i) const
+    {
+        return ptr[i];
+    }
+};
+
+/** Runs the application commands of a Cmdb in asynchronous mode (see Cmdb::async()).
+ */
+class CmdbExecutor
+{
+public:
+    virtual ~CmdbExecutor() {}
+
+    /** Queues the command parsed by cmdb, to be run by calling cmdb.execute() (on any thread).
+     *
+     * Called from scan(), a Cmdb has at most one command queued or running.
+     *
+     * @param cmdb the interpreter with the command.
+     */
+    virtual void submit(Cmdb &cmdb) = 0;
+};
+
 /** Command Interpreter class.
  *
  * Steps to take:
@@ -396,7 +809,7 @@ static const struct esc esc_tbl[ESC_TBL_LEN] = {
  *
  * 2) Create an Cmdb class instance and pass it the vector,
  *    a Serial port object like Serial serial(USBTX, USBRX);
- *    and finally a command dispatcher function.
+ *    (or any other CmdbTransport) and finally a command dispatcher function.
  *
  * 3) Feed the interpreter with characters received from your serial port.
  *    Note: Cmdb self does not retrieve input it must be handed to it.
@@ -421,7 +834,37 @@ public:
      * @param serial a Serial port used for communication.
      * @param cmds a vector with the command table.
      */
+#if defined(__MBED__)
     Cmdb(RawSerial *_serial, std::vector<cmd> &_cmds, void (*_callback)(Cmdb &, int));
+#endif
+
+    /** Create a Command Interpreter on a transport.
+     *
+     * @param transport the transport used for communication (not owned).
+     * @param cmds a vector with the command table.
+     */
+    Cmdb(CmdbTransport *_transport, std::vector<cmd> &_cmds, void (*_callback)(Cmdb &, int));
+
+    /** Create a Command Interpreter on a shared Command Table.
+     *
+     * The table is not copied, so per instance only the line, escape,
+     * parameter and transfer buffers remain.
+     *
+     * @param transport the transport used for communication (not owned).
+     * @param table the command table (not owned, must outlive the instance).
+     */
+    Cmdb(CmdbTransport *_transport, const CmdbTable &_table, void (*_callback)(Cmdb &, int));
+
+#if defined(__MBED__)
+    /** Create a Command Interpreter on a shared Command Table.
+     *
+     * @param serial a Serial port used for communication.
+     * @param table the command table (not owned, must outlive the instance).
+     */
+    Cmdb(RawSerial *_serial, const CmdbTable &_table, void (*_callback)(Cmdb &, int));
+#endif
+
+    ~Cmdb();
 
     /** The version of the Command Interpreter.
      *
@@ -442,7 +885,9 @@ public:
 
     /** Checks if the macro buffer has any characters left.
      *
-     * @returns true if any characters left.
+     * @note Run dispatches pre-compiled macros directly, so there is nothing left to replay.
+     *
+     * @returns false.
      */
     bool macro_hasnext();
 
@@ -464,20 +909,24 @@ public:
      */
     char macro_peek();
 
-    /** Resets the macro buffer and macro buffer pointer.
+    /** Deletes all macros.
      *
      */
     void macro_reset();
 
     /** Checks if the serial port has any characters
-     * left to read by calling serial->readable().
+     * left to read by calling transport->readable().
+     *
+     * After attach() the receive buffer is checked instead.
      *
      * @returns true if any characters available.
      */
     bool hasnext();
 
     /** Gets the next character from the serial port by
-     *  calling serial->getc().
+     *  calling transport->read().
+     *
+     *  After attach() it is taken from the receive buffer instead.
      *
      *  Do not call if no characters are left!
      *
@@ -485,76 +934,255 @@ public:
      */
     char next();
 
-    /** Add a character to the command being processed.
-     * If a cr is added, the command is parsed and executed if possible
-     * If supported special keys are encountered (like backspace, delete and cursor up) they are processed.
+    /** Attaches an interrupt handler to the serial port that moves received
+     *  characters into a receive buffer of MAX_RX_LEN characters.
      *
-     * @param c the character to add.
+     *  The buffer is a lock-free single producer (the interrupt) / single
+     *  consumer (hasnext(), next() and poll()) ring, so characters are no
+     *  longer lost while a command executes or a script is pasted.
      *
-     * @returns true if a command was recognized and executed.
+     * @returns false if the transport has no receive interrupt.
      */
-    bool scan(const char c);
+    bool attach();
 
-    /** printf substitute using the serial parameter passed to the constructor.
+    /** Scans all characters available in bulk, from the receive buffer
+     *  (see attach()) or else directly from the transport.
      *
-     * @see http://www.cplusplus.com/reference/clibrary/cstdio/printf/
-     *
-     * @parm format the printf format string.
-     * @parm ... optional paramaters to be merged into the format string.
+     * Usage: while (true) { cmdb.poll(); }
      *
-     * @returns the printf return value.
+     * @returns the number of complete lines processed.
      */
-    int printf(const char *format, ...);
+    int poll();
 
-    /** print is simply printf without parameters using the serial parameter passed to the constructor.
+    /** The number of characters dropped because the receive buffer was full,
+     *  or because they arrived while a coroutine command was suspended (see coroutines()).
      *
-     * @parm msg the string to print.
+     * @returns the number of overruns.
+     */
+    unsigned long rxoverruns()
+    {
+        return rxdropped;
+    }
+
+    /** The maximum number of characters that were waiting in the receive buffer.
      *
-     * @returns the printf return value.
+     * @returns the receive buffer high-water mark.
      */
-    int print(const char *msg);
+    unsigned int rxhighwater()
+    {
+        return rxpeak;
+    }
 
-    /** println is simply printf without parameters using the serial parameter passed to the constructor.
+    /** Switches this instance to the telnet protocol (RFC 854).
      *
-     * @parm msg the string to print followed by a crlf.
+     * Offers ECHO and SGA and asks the client to edit lines locally (LINEMODE, RFC 1184).
+     * Clients that accept send complete lines and do their own echo, others are served
+     * a character at a time with server side echo as before.
      *
-     * @returns the printf return value.
+     * In telnet mode option negotiation is answered, DEL is a backspace, the NUL or LF
+     * after a CR is dropped and IAC (0xFF) is doubled in the output.
      */
-    int println(const char *msg);
+    void telnet();
 
-    /** printch is simply putc subsitute using the serial parameter passed to the constructor.
+    /** True if the telnet client edits lines locally (see telnet()).
      *
-     * @parm msg the string to print.
-     *
-     * @returns the printf return value.
+     * @returns true if the client accepted LINEMODE.
      */
-    char printch(const char ch);
+    bool linemode()
+    {
+        return tnlinemode;
+    }
 
-    /** printsection prints an inifile Section Header
-     *  like:
+    /** Switches to asynchronous mode, application commands are then run by an executor.
      *
-     *  [Section]\r\n
+     * A parsed command is handed to executor->submit() when scan() returns, without a prompt.
+     * scan(buf, len) stops after such a command, so pass input a line at a time (like poll() does).
+     * The executor calls execute(), which runs the command, prints the prompt and calls done.
+     * Until done returns busy() is true and no input may be scanned (poll() leaves it in the
+     * receive buffer), so the commands of an instance and their done calls run in order.
+     * Predefined commands still run synchronously.
      *
-     *  Usage: cmdb.printsection("GP");
+     * @param _executor the executor (NULL for synchronous mode).
+     * @param _done called (on the thread of execute()) after a command completed or NULL,
+     *        busy() clears right after it returns.
+     * @param _context passed to done.
+     */
+    void async(CmdbExecutor *_executor, void (*_done)(Cmdb &, void *) = NULL, void *_context = NULL);
+
+    /** True while a command is queued or running (asynchronous mode).
      *
-     *  @parm section the section to print.
+     * With C++11 and up, once busy() returns false the writes of the command
+     * (output, buffers and parameters) are visible to the calling thread.
+     * Before C++11 it gives no such ordering, observe completion through the
+     * done function of async() instead.
      *
-     *  @returns the printf return value.
+     * @returns true if no input may be scanned.
      */
-    int printsection(const char *section);
+    bool busy()
+    {
+        return pending;
+    }
 
-    /** printmsg prints an inifile Msg Key=Value pair.
-     *  like:
+    /** Runs the queued command, prints the prompt and calls the done function of async().
      *
-     *  Msg={msg}\r\n
+     * Only to be called by the executor, once for each submit().
+     */
+    void execute();
+
+    /** Registers a coroutine dispatcher for application commands (instead of the callback).
      *
-     *  Usage: cmdb.printmsg("Validation successfull");
+     * Requires CMDB_COROUTINES (C++20). The dispatcher runs inside scan() until it co_awaits
+     * CmdbYield() or returns. A suspended command is continued by resume() and the prompt is
+     * printed when it returns. Meanwhile poll() holds the input in the receive buffer, so it
+     * is processed once the command returns, and only looks for Ctrl-C (0x03, or a telnet IP).
+     * Ctrl-C destroys the coroutine (running the destructors of its locals) and drops the input
+     * before it. So does a full receive buffer, to make room for a Ctrl-C. Input passed to
+     * scan() directly is not held. Dropped characters are counted by rxoverruns().
      *
-     *  @parm msg the msg to print.
+     * Usage: while (true) { cmdb.poll(); cmdb.resume(); }
      *
-     *  @returns the printf return value.
+     * @param _callback the dispatcher (NULL to use the callback again).
      */
-    int printmsg(const char *msg);
+    void coroutines(CmdbTask (*_callback)(Cmdb &, int))
+    {
+        co_callback = _callback;
+    }
+
+    /** Set the buffer array parameters (%*d, %*f etc) are converted into.
+     *
+     * Commands with an array parameter fail if it has more elements than fit.
+     *
+     * @param buf the buffer (aligned for the element types) or NULL.
+     * @param size the size of buf in bytes.
+     */
+    void arraybuffer(void *buf, unsigned int size)
+    {
+        arraybuf  = buf;
+        arraysize = size;
+    }
+
+    /** Skip the rest of a line after a command fails (unknown command or syntax error).
+     *
+     * Commands on a line are separated by ';' and dispatched in order, with one prompt (and flush)
+     * at the end. If stop on error is set, a failed command is reported with its position on the
+     * line (counting from 1) and the commands after it are skipped.
+     *
+     * @param on true to stop at the first failed command.
+     */
+    void stoponerror(bool on)
+    {
+        batchstop = on;
+    }
+
+    /** Runs the suspended coroutine command up to its next co_await.
+     *
+     * @returns true if the command is still running.
+     */
+    bool resume();
+
+    /** True while a coroutine command is suspended.
+     *
+     * @returns true if resume() has work to do.
+     */
+    bool running()
+    {
+        return cotask != NULL;
+    }
+
+    /** Add a character to the command being processed.
+     * If a cr is added, the command is parsed and executed if possible
+     * If supported special keys are encountered (like backspace, delete and cursor up) they are processed.
+     *
+     * @param c the character to add.
+     *
+     * @returns true if a command was recognized and executed.
+     */
+    bool scan(const char c);
+
+    /** Add a buffer of characters to the command being processed.
+     *
+     * Same as calling scan(const char c) for every character, but the output
+     * generated is written in one go.
+     *
+     * @param buf the characters to add.
+     * @param len the number of characters to add.
+     *
+     * @returns the number of complete lines processed (and executed if possible).
+     */
+    int scan(const char *buf, unsigned int len);
+
+    /** printf substitute using the serial parameter passed to the constructor.
+     *
+     * @see http://www.cplusplus.com/reference/clibrary/cstdio/printf/
+     *
+     * @parm format the printf format string.
+     * @parm ... optional paramaters to be merged into the format string.
+     *
+     * @returns the printf return value.
+     */
+    int printf(const char *format, ...) CMDB_PRINTF(2, 3);
+
+    /** vprintf substitute, formats straight into the output buffer.
+     *
+     * Supports the flags -+ #0, width and precision (including *), the length
+     * modifiers hh h l ll j z t and the conversions d i u o x X c s p e E f F g G %.
+     *
+     * @parm format the printf format string.
+     * @parm args the paramaters to be merged into the format string.
+     *
+     * @returns the number of characters written.
+     */
+    int vprintf(const char *format, va_list args);
+
+    /** print is simply printf without parameters using the serial parameter passed to the constructor.
+     *
+     * @parm msg the string to print.
+     *
+     * @returns the printf return value.
+     */
+    int print(const char *msg);
+
+    /** println is simply printf without parameters using the serial parameter passed to the constructor.
+     *
+     * @parm msg the string to print followed by a crlf.
+     *
+     * @returns the printf return value.
+     */
+    int println(const char *msg);
+
+    /** printch is simply putc subsitute using the serial parameter passed to the constructor.
+     *
+     * @parm msg the string to print.
+     *
+     * @returns the printf return value.
+     */
+    char printch(const char ch);
+
+    /** printsection prints an inifile Section Header
+     *  like:
+     *
+     *  [Section]\r\n
+     *
+     *  Usage: cmdb.printsection("GP");
+     *
+     *  @parm section the section to print.
+     *
+     *  @returns the printf return value.
+     */
+    int printsection(const char *section);
+
+    /** printmsg prints an inifile Msg Key=Value pair.
+     *  like:
+     *
+     *  Msg={msg}\r\n
+     *
+     *  Usage: cmdb.printmsg("Validation successfull");
+     *
+     *  @parm msg the msg to print.
+     *
+     *  @returns the printf return value.
+     */
+    int printmsg(const char *msg);
 
     /** printerror prints an inifile Error Section Header and Error Msg Key=Value pair.
      *  like:
@@ -581,7 +1209,7 @@ public:
      *
      * @returns the printf return value.
      */
-    int printerrorf(const char *format, ...);
+    int printerrorf(const char *format, ...) CMDB_PRINTF(2, 3);
 
     /** printvalue prints an inifile Key/Value Pair
      *  like:
@@ -600,7 +1228,7 @@ public:
      *
      * @returns the printf return value.
      */
-    int printvaluef(const char *key, const int width, const char *comment, const char *format, ...);
+    int printvaluef(const char *key, const int width, const char *comment, const char *format, ...) CMDB_PRINTF(5, 6);
 
     /** printvalue prints an inifile Key/Value Pair
      *  like:
@@ -615,7 +1243,7 @@ public:
      *
      * @returns the printf return value.
      */
-    int printvaluef(const char *key, const char *format, ...);
+    int printvaluef(const char *key, const char *format, ...) CMDB_PRINTF(3, 4);
 
     /** printvalue prints an inifile Key/Value Pair
      *  like:
@@ -635,6 +1263,23 @@ public:
 
     int printcomment(const char *comment, const int width = DefComPos);
 
+    /** Writes the output buffer to the serial port.
+     *
+     * Output generated while processing input is buffered until the prompt is written,
+     * the buffer is full or scan() returns. Output generated outside scan() is written
+     * immediately.
+     */
+    void flush();
+
+    /** The number of times the output buffer was written to the serial port.
+     *
+     * @returns the number of flushes.
+     */
+    unsigned long flushes()
+    {
+        return txflushes;
+    }
+
     //------------------------------------------------------------------------------
 
     /** Initializes the parser (called by the constructor).
@@ -767,28 +1412,90 @@ public:
     /** Typecasts parameter ndx to a string.
      *
      * @note spaces are not allowed as it makes parsing so much harder.
+     * @note the string is terminated in place in the command line (not copied),
+     *       it is valid until the command returns. It is const because a
+     *       default (like %s=none) points into the CmdbTable, which is shared
+     *       by all instances. Copy it to modify it.
      *
      * mask: %s
      *
      * @parm the parameter index
      *
-     * @return a string
+     * @return a read-only string
      */
-    char *STRINGPARM(int ndx)
+    const char *STRINGPARM(int ndx)
     {
         return parms[ndx].val.s;
     }
 
-    bool present(char *cmdstr)
+    /** The length of string parameter ndx.
+     *
+     * mask: %s
+     *
+     * @parm the parameter index
+     *
+     * @return the length of STRINGPARM(ndx)
+     */
+    unsigned int STRINGLEN(int ndx)
     {
-        return cmdid_search(cmdstr) != CID_LAST;
+        return parms[ndx].len;
     }
 
-    void replace(std::vector<cmd> &newcmds)
+    /** Typecasts parameter ndx to an array.
+     *
+     * T must match the pattern (int for %*d, float for %*f, unsigned char for %*bu etc).
+     * The elements are in the buffer passed to arraybuffer().
+     *
+     * mask: %*d, %*u, %*x, %*f etc (the last parameter only, any number of elements).
+     *
+     * @parm the parameter index
+     *
+     * @return a view of the elements
+     */
+    template <typename T>
+    CmdbSpan<T> ARRAYPARM(int ndx)
     {
-        cmds.assign(newcmds.begin(), newcmds.end());
+        CmdbSpan<T> span = {(T *)parms[ndx].val.a, parms[ndx].len};
+
+        return span;
+    }
+
+    /** Typecasts parameter ndx to a blob.
+     *
+     * @note the bytes are decoded in place in the command line (not copied),
+     *       they are valid until the command returns.
+     *
+     * mask: %H (hex) or %B (base64)
+     *
+     * @parm the parameter index
+     *
+     * @return a view of the bytes
+     */
+    CmdbSpan<unsigned char> BLOBPARM(int ndx)
+    {
+        return ARRAYPARM<unsigned char>(ndx);
+    }
+
+    /** The number of elements of array parameter ndx.
+     *
+     * mask: %*d, %*u, %*x, %*f etc
+     *
+     * @parm the parameter index
+     *
+     * @return the number of elements
+     */
+    unsigned int ARRAYLEN(int ndx)
+    {
+        return parms[ndx].len;
+    }
+
+    bool present(char *cmdstr)
+    {
+        return cmdid_search(cmdstr) != CID_LAST;
     }
 
+    void replace(std::vector<cmd> &newcmds);
+
     int indexof(int cid)
     {
         return cmdid_index(cid);
@@ -827,15 +1534,27 @@ public:
     */
 
 private:
-    /** Internal Serial Port Storage.
+    /** Common part of the constructors.
+     */
+    void create(void (*_callback)(Cmdb &, int));
+
+#if defined(__MBED__)
+    /** Transport for the RawSerial constructor.
     */
-    RawSerial *serial;
+    CmdbSerial serial;
+#endif
 
-    /** Internal Command Table Vector Storage.
-     *
-     * @see http://www.cplusplus.com/reference/stl/vector/
-     */
-    std::vector<cmd> cmds;
+    /** Internal Transport Storage.
+    */
+    CmdbTransport *transport;
+
+    /** The Command Table (and its indexes) in use.
+    */
+    const CmdbTable *table;
+
+    /** The Command Table built by the std::vector constructors and replace() (else NULL).
+    */
+    CmdbTable *owntable;
 
     /** C callback function
      *
@@ -845,6 +1564,172 @@ private:
      */
     void (*user_callback)(Cmdb &, int);
 
+    /** Executor in asynchronous mode (else NULL).
+     */
+    CmdbExecutor *executor;
+
+    /** Called after a command completed in asynchronous mode.
+     */
+    void (*done)(Cmdb &, void *);
+
+    /** Passed to done.
+     */
+    void *donecontext;
+
+    /** True while a command is queued or running.
+     *
+     * execute() clears it (at least a release) after its last access to the instance,
+     * busy() and poll() read it (at least an acquire) before they scan new input.
+     */
+#if __cplusplus >= 201103L
+    std::atomic<bool> pending;
+#else
+    volatile bool pending;
+#endif
+
+    /** The id of the queued command (its parameters are kept in parms).
+     */
+    int pendingcid;
+
+    /** The handler of the queued command (see cmd.handler) or NULL.
+     */
+    void (*pendinghandler)(Cmdb &);
+
+    /** Coroutine dispatcher (see coroutines()) or NULL.
+     */
+    CmdbTask (*co_callback)(Cmdb &, int);
+
+    /** Frame of the suspended coroutine command (a coroutine_handle address) or NULL.
+     */
+    void *cotask;
+
+    /** Offset of the next command of the line in cmdbuf or -1.
+     */
+    int batchpos;
+
+    /** Number of commands of the line dispatched so far.
+     */
+    int batchno;
+
+    /** Skip the rest of the line after a failed command (see stoponerror()).
+     */
+    bool batchstop;
+
+    /** Destroys the suspended coroutine command after a Ctrl-C.
+     */
+    void cancel();
+
+    /** Not copyable (owntable).
+     */
+    Cmdb(const Cmdb &);
+    Cmdb &operator=(const Cmdb &);
+
+    friend class CmdbTable;
+
+    /** Receive interrupt handler, moves characters from the serial port into rxbuf.
+     */
+    void rx_irq();
+
+    /** Calls rx_irq() on context (passed to CmdbTransport::attach()).
+     */
+    static void rx_thunk(void *context);
+
+    /** Processes a single character for scan().
+     *
+     * @param c the character to add.
+     *
+     * @returns true if a command was recognized and executed.
+     */
+    bool process(const char c);
+
+    /** Decodes a single character of a telnet stream for scan() and passes data on to process().
+     *
+     * @param c the character to add.
+     *
+     * @returns true if a command was recognized and executed.
+     */
+    bool tn_input(const char c);
+
+    /** Answers a telnet option request (WILL, WONT, DO or DONT).
+     *
+     * @param verb the request.
+     * @param opt the option.
+     */
+    void tn_option(unsigned char verb, unsigned char opt);
+
+    /** Handles a telnet subnegotiation collected in tnsb.
+     */
+    void tn_subneg();
+
+    /** Flushes the output buffer and writes a telnet command (without doubling IAC).
+     *
+     * @param data the command.
+     * @param len the length of the command.
+     */
+    void tn_send(const char *data, unsigned int len);
+
+    /** Writes data to the transport, retrying partial writes.
+     *
+     * @param data the data to write.
+     * @param len the number of characters to write.
+     */
+    void txsend(const char *data, unsigned int len);
+
+    /** Appends data to the output buffer, flushing it when full.
+     *
+     * @param data the data to append.
+     * @param len the number of characters to append.
+     *
+     * @returns the number of characters appended.
+     */
+    int txwrite(const char *data, unsigned int len);
+
+    /** Appends n copies of a character to the output buffer.
+     *
+     * @param c the character (only ' ' and '0' are supported).
+     * @param n the number of characters, nothing is appended if n <= 0.
+     *
+     * @returns the number of characters appended.
+     */
+    int txpad(const char c, int n);
+
+    /** Formatting flags.
+    */
+    enum
+    {
+        FMT_LEFT  = 0x01, // -
+        FMT_PLUS  = 0x02, // +
+        FMT_SPACE = 0x04, // space
+        FMT_ALT   = 0x08, // #
+        FMT_ZERO  = 0x10, // 0
+        FMT_UPPER = 0x20  // X, E, F, G
+    };
+
+    /** Formats a string (%s, %c) into the output buffer.
+     *
+     * @returns the number of characters appended.
+     */
+    int fmt_str(const char *s, int len, unsigned char flags, int width);
+
+    /** Formats a cardinal (%d, %i, %u, %o, %x, %X, %p) into the output buffer.
+     *
+     * @param mag the magnitude of the value.
+     * @param neg true if the value is negative.
+     *
+     * @returns the number of characters appended.
+     */
+    int fmt_int(unsigned long long mag, bool neg, unsigned int base, unsigned char flags, int width, int prec);
+
+    /** Formats a floating point value (%e, %f, %g) into the output buffer.
+     *
+     * Prints at most 17 significant digits, followed by zeros if needed.
+     *
+     * @param conv the (lower case) conversion.
+     *
+     * @returns the number of characters appended.
+     */
+    int fmt_float(double v, char conv, unsigned char flags, int width, int prec);
+
     /** Searches the escape code list for a match.
     *
     * @param char* escstr the escape code to lookup.
@@ -859,7 +1744,19 @@ private:
      *
      * @returns the id of the command or -1.
      */
-    int cmdid_search(char *cmdstr);
+    int cmdid_search(const char *cmdstr)
+    {
+        return cmdid_search(cmdstr, strlen(cmdstr));
+    }
+
+    /** Checks if the command table for a match.
+     *
+     * @param cmdstr the command to lookup (does not need to be NULL-Terminated).
+     * @param len the length of the command.
+     *
+     * @returns the id of the command or -1.
+     */
+    int cmdid_search(const char *cmdstr, unsigned int len);
 
     /** Converts an command id to an index of the command table.
      *
@@ -887,8 +1784,25 @@ private:
      * Note: This member calls the callback callback function.
      *
      * @param cmd the command to dispatch.
+     *
+     * @returns false for an unknown command or a syntax error.
+     */
+    bool cmd_dispatcher(char *cmd);
+
+    /** Executes a parsed command (cid, parms, argcnt, argfnd and error), see cmd_dispatcher().
+     *
+     * @param cid the command id (as returned by parse()).
+     * @param cmd the command line or NULL (macro steps).
+     *
+     * @returns false for an unknown command or a syntax error.
+     */
+    bool cmd_execute(int cid, const char *cmd);
+
+    /** Dispatches the ';' separated commands of cmdbuf from batchpos on.
+     *
+     * Returns early when a command is queued or suspended, execute() and resume() continue it.
      */
-    void cmd_dispatcher(char *cmd);
+    void cmd_batch();
 
     /** Generates Help from the command table and prints it.
      *
@@ -933,13 +1847,43 @@ private:
     //int CMD_TBL_LEN;
 
     //Macro's.
-    /** Internal Macro Pointer.
-    */
-    int macro_ptr;
-
-    /** Internal Macro Buffer.
-    */
-    char macro_buf[1 + MAX_CMD_LEN];
+    /** Defines (or replaces) a macro from the parameters of the Macro command (name step|step...).
+     *
+     * Every step is looked up and its parameters converted, so Run can dispatch it directly.
+     *
+     * @returns false if a step is invalid or the store is full.
+     */
+    bool macro_define();
+
+    /** Finds a macro by name (case insensitive).
+     *
+     * @returns the offset of its record in macro_arena or -1.
+     */
+    int macro_find(const char *name, unsigned int len);
+
+    /** Dispatches the steps of a macro, stops at the first failed step.
+     *
+     * @returns false if the macro is unknown, nested too deep or a step failed.
+     */
+    bool macro_run(const char *name);
+
+    /** Macro Store.
+     *
+     * Records of: size (2 bytes), name length, text length, name, text, step count and the steps.
+     * A step is a cid (int), the argument count and per argument its parmtype and value
+     * (an unsigned short length and the terminated characters for strings, an unsigned short
+     * length and the bytes for blobs, an unsigned short count, the element size and the
+     * elements for arrays, else an unsigned long).
+    */
+    unsigned char macro_arena[MAX_MACRO_SIZE];
+
+    /** Bytes used in macro_arena.
+    */
+    unsigned int macro_used;
+
+    /** Nesting level of running macros.
+    */
+    unsigned char macro_depth;
 
     /** Used for parsing parameters.
     */
@@ -954,7 +1898,11 @@ private:
         PARM_SHORT, //4     (w/uw)
 
         PARM_CHAR,  //5     (c/uc)
-        PARM_STRING //6     (s)
+        PARM_STRING,//6     (s)
+
+        PARM_ARRAY, //7     (*)
+
+        PARM_BLOB   //8     (H/B)
     };
 
     /** Used for parsing parameters.
@@ -974,7 +1922,9 @@ private:
         char c;
         unsigned char uc;
 
-        char s[MAX_PARM_LEN];
+        char *s;        // Into the command line (or macro store), terminated in place.
+
+        void *a;        // The array buffer (see arraybuffer()) or a blob decoded in place.
     };
 
     /** Used for parsing parameters.
@@ -982,9 +1932,129 @@ private:
     struct parm
     {
         enum parmtype type;
+        unsigned short len; // Length of a PARM_STRING or PARM_BLOB, elements of a PARM_ARRAY.
         union value val;
     };
 
+    /** Used for parsing parameters.
+     *
+     * A parameter pattern of cmd.parms (like %bu) compiled by CmdbTable.
+    */
+    struct parmdesc
+    {
+        unsigned char type;  // parmtype of the converted value (implies its width).
+        char typ;            // Var type (d, i, u, o, x, e, f, g, c, s, H, B or { for enums).
+        unsigned char size;  // Size of an array element.
+        unsigned char bits;  // Slot bits of the symbol hash (enums).
+        unsigned int slot;   // First slot of the symbol hash in the CmdbTable (enums).
+        unsigned int def;    // Default value in the CmdbTable + 1, 0 if the parameter is required.
+        unsigned int seed;   // Seed of the symbol hash (enums).
+        bool (*conv)(const char *first, const char *last, union value &val); // Conversion kernel (cardinal and floating point types).
+        int (*aconv)(const char *first, const char *last, void *buf, unsigned int max); // Array conversion kernel (same types).
+    };
+
+    /** Used for parsing parameters.
+     *
+     * A token of the commandline.
+    */
+    struct span
+    {
+        unsigned short ofs; // Offset of the token in the commandline.
+        unsigned short len; // Length of the token.
+    };
+
+    /** Compiles a single parameter pattern.
+     *
+     * @param pattern the pattern like %bu.
+     * @param len the length of the pattern.
+     *
+     * @returns the compiled pattern.
+     */
+    static parmdesc compile(const char *pattern, unsigned int len);
+
+    /** Converts a token with a compiled pattern (all types except arrays).
+     *
+     * Strings are terminated and blobs decoded in place.
+     *
+     * @param table the table with the symbol hashes (enums).
+     * @param desc the compiled pattern.
+     * @param tok the token.
+     * @param len the length of the token.
+     * @param val the parameter to store the result in.
+     *
+     * @returns false if the token does not convert.
+     */
+    static bool convert(const CmdbTable &table, const parmdesc &desc, char *tok, unsigned int len, parm &val);
+
+    /** Converts a token to a cardinal type (in the style of std::from_chars).
+     *
+     * The conversion is done in a single pass and fails on overflow instead of
+     * range checking afterwards. There is an instance for every type and base.
+     *
+     * @param first the first character of the token.
+     * @param last the end of the token.
+     * @param val the value to store the result in (at full width).
+     *
+     * @returns true if all of the token was converted and is in range of T.
+     */
+    template <typename T, unsigned int base>
+    static bool to_int(const char *first, const char *last, union value &val);
+
+    /** Converts a token to a float (in the style of std::from_chars).
+     *
+     * Accepts [+-]digits[.digits][(e|E)[+-]digits] without using the (locale aware) strtod().
+     *
+     * @param first the first character of the token.
+     * @param last the end of the token.
+     * @param val the value to store the result in.
+     *
+     * @returns true if all of the token was converted and is in range of a float.
+     */
+    static bool to_float(const char *first, const char *last, union value &val);
+
+    /** Selects the conversion kernels of a cardinal type.
+     *
+     * @param desc the pattern to set conv, aconv and size of.
+     */
+    template <typename T>
+    static void cardinal(parmdesc &desc);
+
+    /** Converts a space separated list of tokens into an array of T.
+     *
+     * Each token is converted like to_int() and stored straight into buf.
+     *
+     * @param first the first character of the list.
+     * @param last the end of the list.
+     * @param buf the array.
+     * @param max the number of elements that fit in buf.
+     *
+     * @returns the number of elements or -1 if a token did not convert or buf is full.
+     */
+    template <typename T, unsigned int base>
+    static int to_ints(const char *first, const char *last, void *buf, unsigned int max);
+
+    /** Converts a space separated list of tokens into an array of floats (see to_ints()).
+     */
+    static int to_floats(const char *first, const char *last, void *buf, unsigned int max);
+
+    /** Decodes a hex token in place.
+     *
+     * @param first the first character of the token (and of the decoded bytes).
+     * @param len the length of the token.
+     *
+     * @returns the number of bytes or -1 if the length is odd or a digit is invalid.
+     */
+    static int hex_decode(char *first, unsigned int len);
+
+    /** Decodes a base64 token (RFC 4648, padding optional) in place.
+     *
+     * @param first the first character of the token (and of the decoded bytes).
+     * @param len the length of the token.
+     *
+     * @returns the number of bytes or -1 if the length or a digit is invalid.
+     */
+    static int b64_decode(char *first, unsigned int len);
+
     //------------------------------------------------------------------------------
     //----Buffers & Storage.
     //------------------------------------------------------------------------------
@@ -995,7 +2065,7 @@ private:
 
     /** Command Buffer Pointer.
     */
-    char cmdndx; // command index
+    unsigned short cmdndx; // command index
 
     /** Last Command Buffer (Used when pressing Cursor Up).
     */
@@ -1009,10 +2079,104 @@ private:
     */
     unsigned char escndx;
 
+    /** Output Buffer.
+    */
+    char txbuf[1 + MAX_TX_LEN];
+
+    /** Output Buffer Pointer.
+    */
+    unsigned int txndx;
+
+    /** Output is held (not flushed after every print) while non zero.
+    */
+    int txhold;
+
+    /** Number of Output Buffer flushes.
+    */
+    unsigned long txflushes;
+
+    /** Receive Buffer (written by rx_irq()).
+    */
+    volatile char rxbuf[MAX_RX_LEN];
+
+    /** Receive Buffer write counter (only written by rx_irq()).
+     *
+     * Free running, rxhead - rxtail is the number of characters waiting.
+    */
+    volatile unsigned int rxhead;
+
+    /** Receive Buffer read counter (never written by rx_irq()).
+    */
+    volatile unsigned int rxtail;
+
+    /** Number of characters dropped by rx_irq() (or by process() while a coroutine command is suspended).
+    */
+    volatile unsigned long rxdropped;
+
+    /** Receive Buffer high-water mark.
+    */
+    volatile unsigned int rxpeak;
+
+    /** True after attach().
+    */
+    bool rxattached;
+
+    /** Telnet decoder states (see tn_input()).
+    */
+    enum tnstates {
+        TNS_OFF = 0,    // Not a telnet session.
+        TNS_DATA,
+        TNS_CR,         // After a CR.
+        TNS_IAC,        // After an IAC.
+        TNS_OPT,        // After IAC WILL/WONT/DO/DONT.
+        TNS_SB,         // In a subnegotiation.
+        TNS_SBIAC       // After an IAC in a subnegotiation.
+    };
+
+    /** Telnet decoder state.
+    */
+    unsigned char tnstate;
+
+    /** Telnet request waiting for its option.
+    */
+    unsigned char tnverb;
+
+    /** Telnet subnegotiation buffer (longer subnegotiations are truncated).
+    */
+    unsigned char tnsb[4];
+
+    /** Telnet subnegotiation length.
+    */
+    unsigned char tnsblen;
+
+    /** True if the telnet client accepted LINEMODE.
+    */
+    bool tnlinemode;
+
+    /** True if we offered or agreed to do the telnet echo.
+    */
+    bool tnecho;
+
+    /** True if we offered or agreed to suppress go ahead.
+    */
+    bool tnsga;
+
+    /** True if the client agreed to suppress go ahead.
+    */
+    bool tnpeersga;
+
     /** Storage for Parsed Parameters
     */
     struct parm parms[MAX_ARGS];
 
+    /** Buffer of array parameters (see arraybuffer()).
+    */
+    void *arraybuf;
+
+    /** Size of arraybuf in bytes.
+    */
+    unsigned int arraysize;
+
     /** Parsed Parameters Pointer.
      */
     int noparms;
@@ -1034,6 +2198,1193 @@ private:
     int error;
 };
 
+//------------------------------------------------------------------------------
+
+#if __cplusplus >= 201402L
+/** Upper-cases a character (same as the runtime lookup).
+ */
+constexpr char cmdb_fold(const char c)
+{
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+/** FNV-1a hash of an upper-cased command name (same as the runtime lookup).
+ */
+constexpr unsigned int cmdb_hash(const char *name)
+{
+    unsigned int hash = FNV_BASIS;
+
+    for (; *name; name++) {
+        hash = ((hash ^ (unsigned char)cmdb_fold(*name)) * FNV_PRIME) & 0xFFFFFFFFu;
+    }
+
+    return hash;
+}
+
+/** Compares two command names case insensitive.
+ */
+constexpr bool cmdb_same(const char *a, const char *b)
+{
+    for (; *a && cmdb_fold(*a) == cmdb_fold(*b); a++, b++);
+
+    return cmdb_fold(*a) == cmdb_fold(*b);
+}
+
+/** Checks the symbols of an enum pattern like %{on|off}: 1 to 255, not empty and no duplicates (case insensitive).
+ */
+constexpr bool cmdb_symbols(const char *p, unsigned int len)
+{
+    if (len < 4 || p[len - 1] != '}') {
+        return false;
+    }
+
+    unsigned int n = 0;
+
+    for (unsigned int i = 2; i < len - 1; n++) {
+        unsigned int l = 0;
+
+        while (i + l < len - 1 && p[i + l] != '|') {
+            if (p[i + l] == '{' || p[i + l] == '}') {
+                return false;
+            }
+            l++;
+        }
+
+        if (l == 0 || n == 255) {
+            return false;
+        }
+
+        //Compare with the symbols before it.
+        for (unsigned int j = 2; j < i; ) {
+            unsigned int m = 0;
+
+            while (p[j + m] != '|') {
+                m++;
+            }
+
+            if (m == l) {
+                unsigned int k = 0;
+
+                while (k < l && cmdb_fold(p[j + k]) == cmdb_fold(p[i + k])) {
+                    k++;
+                }
+
+                if (k == l) {
+                    return false;
+                }
+            }
+
+            j += m + 1;
+        }
+
+        i += l + 1;
+
+        //A trailing | is an empty symbol.
+        if (i == len - 1 && p[i - 1] == '|') {
+            return false;
+        }
+    }
+
+    return n > 0;
+}
+
+/** Checks a single parameter pattern like %bu, %*d, %H or %{on|off} (see Cmdb::compile()).
+ */
+constexpr bool cmdb_pattern(const char *p, unsigned int len)
+{
+    if (len < 2 || p[0] != '%') {
+        return false;
+    }
+
+    if (p[1] == '{') {
+        return cmdb_symbols(p, len);
+    }
+
+    const bool array = (p[1] == '*');
+
+    if (array) {
+        p++;
+        len--;
+    }
+
+    if (len < 2 || len > 3) {
+        return false;
+    }
+
+    const char mod = (len == 3) ? p[1] : '\0';
+    const char typ = p[len - 1];
+
+    switch (typ) {
+        case 'c': case 's':
+            if (array) {
+                return false;
+            }
+            return mod == '\0' || mod == 'b' || mod == 'h' || mod == 'l';
+        case 'H': case 'B':
+            return !array && mod == '\0';
+        case 'd': case 'i': case 'u': case 'o': case 'x':
+        case 'e': case 'f': case 'g':
+            return mod == '\0' || mod == 'b' || mod == 'h' || mod == 'l';
+    }
+
+    return false;
+}
+
+/** Length of the key of a named pattern like baud=%i (up to the %, so with the =), 0 for a positional one.
+ */
+constexpr unsigned int cmdb_keylen(const char *p, unsigned int len)
+{
+    unsigned int k = 0;
+
+    while (k < len && p[k] != '%') {
+        k++;
+    }
+
+    return k;
+}
+
+/** Length of a pattern like %i=10 or %{on|off}=on without its default.
+ */
+constexpr unsigned int cmdb_speclen(const char *p, unsigned int len)
+{
+    const char end = (len > 1 && p[1] == '{') ? '}' : '=';
+    unsigned int s = 0;
+
+    while (s < len && p[s] != end) {
+        s++;
+    }
+
+    return (end == '}' && s < len) ? s + 1 : s;
+}
+
+/** Checks the key of a named pattern (an identifier and =), unique among the first n patterns of parms (case insensitive).
+ */
+constexpr bool cmdb_key(const char *parms, unsigned int n, const char *key, unsigned int k)
+{
+    if (k < 2 || key[k - 1] != '=') {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < k - 1; i++) {
+        const char c = cmdb_fold(key[i]);
+
+        if (!((c >= 'A' && c <= 'Z') || c == '_' || (i > 0 && c >= '0' && c <= '9'))) {
+            return false;
+        }
+    }
+
+    while (n) {
+        unsigned int len = 0;
+
+        while (parms[len] && parms[len] != ' ') {
+            len++;
+        }
+
+        if (len && cmdb_keylen(parms, len) == k) {
+            unsigned int i = 0;
+
+            while (i < k && cmdb_fold(parms[i]) == cmdb_fold(key[i])) {
+                i++;
+            }
+
+            if (i == k) {
+                return false;
+            }
+        }
+
+        if (len) {
+            n--;
+        }
+
+        parms += len;
+        while (*parms == ' ') {
+            parms++;
+        }
+    }
+
+    return true;
+}
+
+/** Checks a cardinal default like Cmdb::to_int() converts it, in range of the type of pattern p (like %bu).
+ */
+constexpr bool cmdb_cardinal(const char *p, unsigned int len, const char *def, unsigned int dlen)
+{
+    const char mod = (len == 3) ? p[1] : '\0';
+    const char typ = p[len - 1];
+    const bool sig = (typ == 'd' || typ == 'i');
+    const unsigned int base = (typ == 'o') ? 8 : (typ == 'x') ? 16 : 10;
+
+    const unsigned long max = mod == 'b' ? (sig ? std::numeric_limits<signed char>::max() : std::numeric_limits<unsigned char>::max()) :
+                              mod == 'h' ? (sig ? std::numeric_limits<short>::max() : std::numeric_limits<unsigned short>::max()) :
+                              mod == 'l' ? (sig ? std::numeric_limits<long>::max() : std::numeric_limits<unsigned long>::max()) :
+                              (sig ? std::numeric_limits<int>::max() : std::numeric_limits<unsigned int>::max());
+
+    unsigned int i = 0;
+    bool neg = false;
+
+    if (i < dlen && (def[i] == '-' || def[i] == '+')) {
+        neg = (def[i++] == '-');
+
+        if (neg && !sig) {
+            return false;
+        }
+    }
+
+    if (base == 16 && dlen - i > 2 && def[i] == '0' && (def[i + 1] | 0x20) == 'x') {
+        i += 2;
+    }
+
+    if (i == dlen) {
+        return false;
+    }
+
+    const unsigned long limit = neg ? max + 1 : max;
+    unsigned long v = 0;
+
+    for (; i < dlen; i++) {
+        const char c = cmdb_fold(def[i]);
+        const unsigned int d = (c >= '0' && c <= '9') ? c - '0' : (c >= 'A' && c <= 'Z') ? c - 'A' + 10 : 36;
+
+        if (d >= base || v > (limit - d) / base) {
+            return false;
+        }
+
+        v = v * base + d;
+    }
+
+    return true;
+}
+
+/** Checks a floating point default like Cmdb::to_float() converts it (same digits, scaling and float range).
+ */
+constexpr bool cmdb_float(const char *def, unsigned int dlen)
+{
+    unsigned long mant = 0;
+    int digits = 0;
+    int exp10  = 0;
+    bool any   = false;
+    unsigned int i = 0;
+
+    if (i < dlen && (def[i] == '-' || def[i] == '+')) {
+        i++;
+    }
+
+    for (; i < dlen && def[i] >= '0' && def[i] <= '9'; i++) {
+        any = true;
+        if (digits < 9) {
+            if (mant || def[i] != '0') {
+                mant = mant * 10 + (def[i] - '0');
+                digits++;
+            }
+        } else {
+            exp10++;
+        }
+    }
+
+    if (i < dlen && def[i] == '.') {
+        for (i++; i < dlen && def[i] >= '0' && def[i] <= '9'; i++) {
+            any = true;
+            if (digits < 9) {
+                if (mant || def[i] != '0') {
+                    mant = mant * 10 + (def[i] - '0');
+                    digits++;
+                }
+                exp10--;
+            }
+        }
+    }
+
+    if (!any) {
+        return false;
+    }
+
+    if (i < dlen && (def[i] | 0x20) == 'e') {
+        bool eneg = false;
+        int e = 0;
+
+        if (++i < dlen && (def[i] == '-' || def[i] == '+')) {
+            eneg = (def[i++] == '-');
+        }
+
+        if (i == dlen) {
+            return false;
+        }
+
+        for (; i < dlen && def[i] >= '0' && def[i] <= '9'; i++) {
+            if (e < 1000) {
+                e = e * 10 + (def[i] - '0');
+            }
+        }
+
+        exp10 += eneg ? -e : e;
+    }
+
+    if (i != dlen) {
+        return false;
+    }
+
+    if (mant == 0) {
+        return true;
+    }
+
+    //Powers of ten up to 1e22 are exact, so this scales like the runtime table does.
+    double d = mant;
+    double p = 1;
+
+    while (exp10 > 22 && d <= std::numeric_limits<float>::max()) {
+        d *= 1e22;
+        exp10 -= 22;
+    }
+
+    if (exp10 > 22) {
+        return false;
+    }
+
+    for (int k = 0; k < exp10; k++) {
+        p *= 10;
+    }
+
+    return exp10 < 0 || d * p <= std::numeric_limits<float>::max();
+}
+
+/** Checks the default of a pattern like %i=10 the way CmdbTable converts it.
+ *
+ * Not empty, in range of a cardinal or float type, a single character (%c), an even
+ * number of hex digits (%H) or one of the symbols (enums). Strings and base64 (%B)
+ * are taken as is (a base64 default that does not decode is reported by CmdbTable).
+ */
+constexpr bool cmdb_default(const char *p, unsigned int len, const char *def, unsigned int dlen)
+{
+    if (dlen == 0) {
+        return false;
+    }
+
+    if (p[1] != '{') {
+        switch (p[len - 1]) {
+            case 'c':
+                return dlen == 1;
+            case 'd': case 'i': case 'u': case 'o': case 'x':
+                return cmdb_cardinal(p, len, def, dlen);
+            case 'e': case 'f': case 'g':
+                return cmdb_float(def, dlen);
+            case 'H':
+                for (unsigned int i = 0; i < dlen; i++) {
+                    const char c = cmdb_fold(def[i]);
+
+                    if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F'))) {
+                        return false;
+                    }
+                }
+                return dlen % 2 == 0;
+        }
+
+        return true;
+    }
+
+    for (unsigned int i = 2; i < len - 1; ) {
+        unsigned int l = 0;
+
+        while (p[i + l] != '|' && p[i + l] != '}') {
+            l++;
+        }
+
+        if (l == dlen) {
+            unsigned int k = 0;
+
+            while (k < l && cmdb_fold(p[i + k]) == cmdb_fold(def[k])) {
+                k++;
+            }
+
+            if (k == l) {
+                return true;
+            }
+        }
+
+        i += l + 1;
+    }
+
+    return false;
+}
+
+/** Checks the parameter patterns of a command (at most MAX_ARGS, space separated, an array last).
+ *
+ * Required positional patterns come first, then those with a default (like %i=10), then
+ * named ones (like baud=%i=9600). Arrays are neither named nor defaulted (they may be empty).
+ */
+constexpr bool cmdb_parms(const char *parms)
+{
+    const char *first = parms;
+    unsigned int argc = 0;
+    bool array = false;
+    bool optional = false;
+    bool named = false;
+
+    while (*parms) {
+        unsigned int len = 0;
+
+        while (parms[len] && parms[len] != ' ') {
+            len++;
+        }
+
+        if (len) {
+            const unsigned int k = cmdb_keylen(parms, len);
+            const unsigned int s = cmdb_speclen(parms + k, len - k);
+            const bool key = (k > 0);
+            const bool def = (k + s < len);
+
+            if (array || k == len || !cmdb_pattern(parms + k, s) || ++argc > MAX_ARGS) {
+                return false;
+            }
+            array = (parms[k + 1] == '*');
+
+            if (array ? (key || def || named) : (!key && (named || (optional && !def)))) {
+                return false;
+            }
+
+            if (key && !cmdb_key(first, argc - 1, parms, k)) {
+                return false;
+            }
+
+            if (def && !cmdb_default(parms + k, s, parms + k + s + 1, len - k - s - 1)) {
+                return false;
+            }
+
+            optional = optional || def;
+            named    = named || key;
+        }
+
+        parms += len;
+        while (*parms == ' ') {
+            parms++;
+        }
+    }
+
+    return true;
+}
+
+/** True if no two commands share a cid.
+ */
+template <unsigned int N>
+constexpr bool cmdb_unique_cids(const cmd (&cmds)[N])
+{
+    for (unsigned int i = 0; i < N; i++) {
+        for (unsigned int j = i + 1; j < N; j++) {
+            if (cmds[i].cid == cmds[j].cid) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/** True if no two commands with the same name are visible at the same time.
+ *
+ * Global commands and subsystems are visible everywhere, other commands only
+ * in their own subsystem.
+ */
+template <unsigned int N>
+constexpr bool cmdb_unique_names(const cmd (&cmds)[N])
+{
+    for (unsigned int i = 0; i < N; i++) {
+        for (unsigned int j = i + 1; j < N; j++) {
+            if ((cmds[i].subs == cmds[j].subs || cmds[i].subs < 0 || cmds[j].subs < 0) &&
+                    cmdb_same(cmds[i].cmdstr, cmds[j].cmdstr)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/** True if all commands have a name without spaces and valid parameter patterns.
+ */
+template <unsigned int N>
+constexpr bool cmdb_valid_cmds(const cmd (&cmds)[N])
+{
+    for (unsigned int i = 0; i < N; i++) {
+        if (!cmds[i].cmdstr[0] || !cmds[i].parms || !cmdb_parms(cmds[i].parms)) {
+            return false;
+        }
+        for (const char *c = cmds[i].cmdstr; *c; c++) {
+            if (*c == ' ') {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/** True if all subsystem commands belong to a subsystem in the table.
+ */
+template <unsigned int N>
+constexpr bool cmdb_valid_subs(const cmd (&cmds)[N])
+{
+    for (unsigned int i = 0; i < N; i++) {
+        if (cmds[i].subs >= 0) {
+            unsigned int j = 0;
+
+            while (j < N && !(cmds[j].cid == cmds[i].subs &&
+                              (cmds[j].subs == SUBSYSTEM || cmds[j].subs == HIDDENSUB))) {
+                j++;
+            }
+            if (j == N) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/** Rejects invalid command tables at compile time.
+ *
+ * The checks compare every pair of commands, so tables of more than a few hundred
+ * commands may need a higher constexpr operation limit (-fconstexpr-ops-limit with GCC).
+ *
+ * Usage: static constexpr cmd cmds[] = {...}; CMDB_VALIDATE(cmds);
+ */
+#define CMDB_VALIDATE(cmds) \
+    static_assert(cmdb_unique_cids(cmds), "Duplicate cid in " #cmds); \
+    static_assert(cmdb_unique_names(cmds), "Duplicate command name within a subsystem in " #cmds); \
+    static_assert(cmdb_valid_cmds(cmds), "Malformed command name or % parameter pattern in " #cmds); \
+    static_assert(cmdb_valid_subs(cmds), "Command of an unknown subsystem in " #cmds)
+
+/** Called (at compile time) if no perfect hash could be found.
+ *
+ * Not constexpr, so it turns the constexpr CmdbIndex construction into an error.
+ */
+void cmdb_no_perfect_hash();
+
+/** Compile-time perfect hash lookup for a constexpr command table.
+ *
+ * Hash and displace: names are distributed over buckets and each bucket gets
+ * the first displacement that puts all its names in free slots. Commands with
+ * the same name (in different subsystems) share a slot and are chained in
+ * table order. Cids are indexed the same way. Both take a single probe at runtime.
+ *
+ * Up to 32767 commands, like the runtime index. Tables of more than a few hundred
+ * commands may need a higher constexpr operation limit (-fconstexpr-ops-limit with GCC).
+ *
+ * Must be constexpr, usage: static constexpr CmdbIndex<N> cmds_index(cmds); static CmdbTable table(cmds, cmds_index);
+ */
+template <unsigned int N>
+struct CmdbIndex
+{
+    static_assert(N > 0 && N < 32768, "CmdbIndex supports 1..32767 commands");
+
+    /** The smallest width with at least n slots.
+     */
+    static constexpr unsigned int width(unsigned int n)
+    {
+        unsigned int b = 1;
+
+        while ((1u << b) < n) {
+            b++;
+        }
+
+        return b;
+    }
+
+    static constexpr unsigned int BITS  = width(2 * N);     // Slots (load factor <= 50%).
+    static constexpr unsigned int BBITS = width(N / 2);     // Buckets (about 2 names per bucket).
+
+    unsigned short slot[1u << BITS];        // Command index + 1 by name, 0 if empty.
+    unsigned short next[N];                 // Next command index + 1 with the same name, 0 if none.
+    unsigned short disp[1u << BBITS];       // Displacement per name bucket.
+    unsigned short cidslot[1u << BITS];     // Command index + 1 by cid, 0 if empty.
+    unsigned short ciddisp[1u << BBITS];    // Displacement per cid bucket.
+
+    constexpr CmdbIndex(const cmd (&cmds)[N]) : slot(), next(), disp(), cidslot(), ciddisp()
+    {
+        unsigned int hash[N] = {};
+        bool first[N] = {};
+        unsigned int cidhash[N] = {};
+        bool cidfirst[N] = {};
+
+        //Only the first command of a name (or cid) is placed, others are chained (or unreachable).
+        for (unsigned int i = 0; i < N; i++) {
+            hash[i]     = cmdb_hash(cmds[i].cmdstr);
+            cidhash[i]  = (unsigned int)cmds[i].cid & 0xFFFFFFFFu;
+            first[i]    = true;
+            cidfirst[i] = true;
+
+            for (unsigned int j = 0; j < i; j++) {
+                if (first[j] && cmdb_same(cmds[i].cmdstr, cmds[j].cmdstr)) {
+                    first[i] = false;
+                }
+                if (cmds[i].cid == cmds[j].cid) {
+                    cidfirst[i] = false;
+                }
+            }
+
+            for (unsigned int j = i + 1; j < N && !next[i]; j++) {
+                if (cmdb_same(cmds[i].cmdstr, cmds[j].cmdstr)) {
+                    next[i] = j + 1;
+                }
+            }
+        }
+
+        place(hash, first, slot, disp);
+        place(cidhash, cidfirst, cidslot, ciddisp);
+    }
+
+private:
+    static constexpr void place(const unsigned int (&hash)[N], const bool (&use)[N],
+                                unsigned short (&slots)[1u << BITS], unsigned short (&disps)[1u << BBITS])
+    {
+        unsigned int bucket[N] = {};
+        unsigned int size[1u << BBITS] = {};
+
+        for (unsigned int i = 0; i < N; i++) {
+            if (use[i]) {
+                bucket[i] = cmdb_mix(hash[i], 0, BBITS);
+                size[bucket[i]]++;
+            }
+        }
+
+        //Largest buckets first, while most slots are still free.
+        for (unsigned int n = N; n > 0; n--) {
+            for (unsigned int b = 0; b < (1u << BBITS); b++) {
+                if (size[b] != n) {
+                    continue;
+                }
+
+                unsigned int member[N] = {};
+                unsigned int pos[N] = {};
+                unsigned int k = 0;
+
+                for (unsigned int i = 0; i < N; i++) {
+                    if (use[i] && bucket[i] == b) {
+                        member[k++] = i;
+                    }
+                }
+
+                //Find the first displacement that puts all names of the bucket in distinct free slots.
+                for (unsigned int d = 0; ; d++) {
+                    unsigned int j = 0;
+
+                    if (d == 0xFFFF) {
+                        cmdb_no_perfect_hash();
+                    }
+
+                    for (; j < k; j++) {
+                        pos[j] = cmdb_mix(hash[member[j]], d + 1, BITS);
+
+                        unsigned int m = 0;
+
+                        while (m < j && pos[m] != pos[j]) {
+                            m++;
+                        }
+
+                        if (slots[pos[j]] || m < j) {
+                            break;
+                        }
+                    }
+
+                    if (j == k) {
+                        disps[b] = d;
+                        break;
+                    }
+                }
+
+                for (unsigned int j = 0; j < k; j++) {
+                    slots[pos[j]] = member[j] + 1;
+                }
+            }
+        }
+    }
+};
+#endif
+
+#if __cplusplus >= 201402L
+/** A command handler (see cmd.handler).
+ */
+typedef void (*CmdbHandler)(Cmdb &);
+
+/** Type of a typed handler parameter, with its code (see cmdb_code()) and getter.
+ *
+ * Only the listed types are supported, arrays (%*d etc) are a CmdbSpan of them and
+ * blobs (%H, %B) a CmdbSpan<unsigned char>.
+ */
+template <typename T>
+struct CmdbArg
+{
+    static constexpr int code() { return 0; }
+};
+
+template <> struct CmdbArg<float>          { static constexpr int code() { return 'f'; } static float get(Cmdb &cmdb, int ndx) { return cmdb.FLOATPARM(ndx); } };
+template <> struct CmdbArg<long>           { static constexpr int code() { return 'l'; } static long get(Cmdb &cmdb, int ndx) { return cmdb.LONGPARM(ndx); } };
+template <> struct CmdbArg<unsigned long>  { static constexpr int code() { return 'L'; } static unsigned long get(Cmdb &cmdb, int ndx) { return cmdb.DWORDPARM(ndx); } };
+template <> struct CmdbArg<int>            { static constexpr int code() { return 'i'; } static int get(Cmdb &cmdb, int ndx) { return cmdb.INTPARM(ndx); } };
+template <> struct CmdbArg<unsigned int>   { static constexpr int code() { return 'I'; } static unsigned int get(Cmdb &cmdb, int ndx) { return cmdb.UINTPARM(ndx); } };
+template <> struct CmdbArg<short>          { static constexpr int code() { return 'h'; } static short get(Cmdb &cmdb, int ndx) { return (short)cmdb.WORDPARM(ndx); } };
+template <> struct CmdbArg<unsigned short> { static constexpr int code() { return 'H'; } static unsigned short get(Cmdb &cmdb, int ndx) { return (unsigned short)cmdb.WORDPARM(ndx); } };
+template <> struct CmdbArg<signed char>    { static constexpr int code() { return 'b'; } static signed char get(Cmdb &cmdb, int ndx) { return (signed char)cmdb.BYTEPARM(ndx); } };
+template <> struct CmdbArg<unsigned char>  { static constexpr int code() { return 'B'; } static unsigned char get(Cmdb &cmdb, int ndx) { return cmdb.BYTEPARM(ndx); } };
+template <> struct CmdbArg<char>           { static constexpr int code() { return 'c'; } static char get(Cmdb &cmdb, int ndx) { return cmdb.CHARPARM(ndx); } };
+template <typename T>
+struct CmdbArg<CmdbSpan<T> >
+{
+    static constexpr int code() { return CmdbArg<T>::code() | 0x100; }
+    static CmdbSpan<T> get(Cmdb &cmdb, int ndx) { return cmdb.ARRAYPARM<T>(ndx); }
+};
+
+template <> struct CmdbArg<const char *>   { static constexpr int code() { return 's'; } static const char *get(Cmdb &cmdb, int ndx) { return cmdb.STRINGPARM(ndx); } };
+
+/** The CmdbArg code of the C++ type a parameter pattern like %bu converts to (CmdbSpan for %*d etc).
+ */
+constexpr int cmdb_code(const char *p, unsigned int len)
+{
+    if (p[1] == '*') {
+        return cmdb_code(p + 1, len - 1) | 0x100;
+    }
+
+    if (p[1] == '{') {
+        return 'i';                                 // The position of the symbol.
+    }
+
+    const char mod = (len == 3) ? p[1] : '\0';
+
+    switch (p[len - 1]) {
+        case 'd': case 'i':
+            return mod == 'b' ? 'b' : mod == 'h' ? 'h' : mod == 'l' ? 'l' : 'i';
+        case 'u': case 'o': case 'x':
+            return mod == 'b' ? 'B' : mod == 'h' ? 'H' : mod == 'l' ? 'L' : 'I';
+        case 'e': case 'f': case 'g':
+            return 'f';
+        case 'c':
+            return 'c';
+        case 's':
+            return 's';
+        case 'H': case 'B':
+            return 'B' | 0x100;                     // CmdbSpan<unsigned char>
+    }
+
+    return 0;
+}
+
+/** True if the parameter patterns of a command match the n CmdbArg codes of a typed handler.
+ */
+constexpr bool cmdb_signature(const char *parms, const int *codes, unsigned int n)
+{
+    unsigned int argc = 0;
+
+    while (*parms) {
+        unsigned int len = 0;
+
+        while (parms[len] && parms[len] != ' ') {
+            len++;
+        }
+
+        if (len) {
+            const unsigned int k = cmdb_keylen(parms, len);
+            const unsigned int s = cmdb_speclen(parms + k, len - k);
+
+            if (argc == n || k == len || !cmdb_pattern(parms + k, s) || cmdb_code(parms + k, s) != codes[argc]) {
+                return false;
+            }
+            argc++;
+        }
+
+        parms += len;
+        while (*parms == ' ') {
+            parms++;
+        }
+    }
+
+    return argc == n;
+}
+
+/** Adapts a typed handler like void add(Cmdb &cmdb, int a, int b) to a CmdbHandler.
+ *
+ * call() passes the parsed parameters straight to f, by position.
+ */
+template <typename F, F f>
+struct CmdbThunk
+{
+    static_assert(sizeof(F) == 0, "A typed handler must be a void function of (Cmdb &, parameters...)");
+};
+
+template <typename... A, void (*f)(Cmdb &, A...)>
+struct CmdbThunk<void (*)(Cmdb &, A...), f>
+{
+    static constexpr bool matches(const char *parms)
+    {
+        const int codes[] = {CmdbArg<A>::code()..., 0};
+
+        return cmdb_signature(parms, codes, sizeof...(A));
+    }
+
+    static void call(Cmdb &cmdb)
+    {
+        invoke(cmdb, std::index_sequence_for<A...>());
+    }
+
+private:
+    template <std::size_t... I>
+    static void invoke(Cmdb &cmdb, std::index_sequence<I...>)
+    {
+        (void)cmdb;
+        (*f)(cmdb, CmdbArg<A>::get(cmdb, I)...);
+    }
+};
+
+/** Fails to compile if a typed handler does not match its parameter patterns.
+ */
+template <bool ok>
+struct CmdbCheck
+{
+    static_assert(ok, "Typed handler parameters do not match the % parameter patterns of the command");
+
+    static constexpr CmdbHandler handler(CmdbHandler h)
+    {
+        return h;
+    }
+};
+
+/** The CmdbHandler of typed handler fn, checked at compile time against parms.
+ */
+#define CMDB_HANDLER(fn, parms) \
+    CmdbCheck<CmdbThunk<decltype(&fn), &fn>::matches(parms)>::handler(&CmdbThunk<decltype(&fn), &fn>::call)
+
+/** A command table entry with a typed handler.
+ *
+ * Usage: static void add(Cmdb &cmdb, int a, int b) {...}
+ *        static constexpr cmd cmds[] = {CMDB_CMD("Add", GLOBALCMD, CID_ADD, "%i %i", "Add two numbers", "a b", add), ...};
+ */
+#define CMDB_CMD(cmdstr, subs, cid, parms, cmddescr, parmdescr, fn) \
+    {cmdstr, subs, cid, parms, cmddescr, parmdescr, CMDB_HANDLER(fn, parms)}
+#endif
+
+//------------------------------------------------------------------------------
+
+/** Command Table with its lookup indexes.
+ *
+ * Immutable after construction, so any number of Cmdb instances (one per
+ * port or client) can share a single table.
+ *
+ * Up to 32767 commands (the runtime indexes hold a short). Names, symbols,
+ * keys, defaults and signatures are kept at 32 bit offsets, so their total
+ * size does not limit the table.
+ *
+ * Usage: static CmdbTable table(cmds); Cmdb a(&port1, table, dispatch), b(&port2, table, dispatch);
+ */
+class CmdbTable
+{
+public:
+    /** Create a Command Table from a copy of a vector.
+     *
+     * @param cmds a vector with the command table.
+     */
+    CmdbTable(const std::vector<cmd> &_cmds);
+
+    /** Create a Command Table on a const array (not copied, so it stays in flash).
+     *
+     * The predefined commands (except BOOT) missing from the array are served
+     * from a const table of their own, so only application commands are required.
+     *
+     * @param cmds the command table (must outlive the CmdbTable).
+     * @param count the number of commands.
+     */
+    CmdbTable(const cmd *_cmds, unsigned int _count);
+
+    /** Create a Command Table on a const array (not copied, so it stays in flash).
+     *
+     * Usage: static const cmd cmds[] = {...}; static CmdbTable table(cmds);
+     *
+     * @param cmds the command table (must outlive the CmdbTable).
+     */
+    template <unsigned int N>
+    CmdbTable(const cmd (&_cmds)[N]) : tbl(_cmds), count(N)
+    {
+        pre.slot = NULL;
+
+        builtins();
+        reindex();
+    }
+
+#if __cplusplus >= 201402L
+    /** Create a Command Table on a constexpr array with its compile-time index.
+     *
+     * Only the compiled parameter signatures are built at runtime.
+     *
+     * Usage: static constexpr cmd cmds[] = {...}; CMDB_VALIDATE(cmds);
+     *        static constexpr CmdbIndex<sizeof(cmds) / sizeof(cmds[0])> cmds_index(cmds);
+     *        static CmdbTable table(cmds, cmds_index);
+     *
+     * @param cmds the command table (must outlive the CmdbTable).
+     * @param index the index of cmds (must outlive the CmdbTable).
+     */
+    template <unsigned int N>
+    CmdbTable(const cmd (&_cmds)[N], const CmdbIndex<N> &_index) : tbl(_cmds), count(N)
+    {
+        pre.slot    = _index.slot;
+        pre.next    = _index.next;
+        pre.disp    = _index.disp;
+        pre.cidslot = _index.cidslot;
+        pre.ciddisp = _index.ciddisp;
+        pre.bits    = CmdbIndex<N>::BITS;
+        pre.bbits   = CmdbIndex<N>::BBITS;
+
+        builtins();
+        reindex();
+    }
+#endif
+
+    /** The number of commands.
+     *
+     * @returns the number of commands.
+     */
+    unsigned int size() const
+    {
+        return count + extra.size();
+    }
+
+    /** A command.
+     *
+     * @param ndx the command index.
+     *
+     * @returns the command.
+     */
+    const cmd &entry(int ndx) const
+    {
+        return (unsigned int)ndx < count ? tbl[ndx] : *extra[ndx - count];
+    }
+
+    /** Searches a command by name (case insensitive) visible in a subsystem.
+     *
+     * @param cmdstr the command to lookup (does not need to be NULL-Terminated).
+     * @param len the length of the command.
+     * @param subsystem the active subsystem.
+     *
+     * @returns the command index or -1 if not found.
+     */
+    int search(const char *cmdstr, unsigned int len, int subsystem) const;
+
+    /** Searches the (first) command with a cid.
+     *
+     * @param cid the command id.
+     *
+     * @returns the command index or -1 if not found.
+     */
+    int index(int cid) const;
+
+    /** The compiled parameter signature of a command.
+     *
+     * @param ndx the command index.
+     *
+     * @returns argc(ndx) compiled parameter patterns.
+     */
+    const Cmdb::parmdesc *signature(int ndx) const
+    {
+        return sigs.empty() ? NULL : &sigs[keys[ndx].sig];
+    }
+
+    /** The number of parameters of a command.
+     *
+     * @param ndx the command index.
+     *
+     * @returns the number of parameters.
+     */
+    int argc(int ndx) const
+    {
+        return keys[ndx].argc;
+    }
+
+    /** Resolves a symbol of an enum parameter (%{a|b|c}) with its perfect hash.
+     *
+     * @param desc the compiled pattern.
+     * @param sym the symbol (case insensitive, does not need to be NULL-Terminated).
+     * @param len the length of the symbol.
+     *
+     * @returns the position of the symbol in the pattern (counting from 0) or -1 if it is not listed.
+     */
+    int symbol(const Cmdb::parmdesc &desc, const char *sym, unsigned int len) const;
+
+    /** The first named parameter (like baud=%i) of a command, named parameters come last.
+     *
+     * @param ndx the command index.
+     *
+     * @returns the index of the parameter or argc(ndx) if there are none.
+     */
+    int named(int ndx) const
+    {
+        return keys[ndx].named;
+    }
+
+    /** Resolves the key of a named parameter with the key hash of its command.
+     *
+     * @param ndx the command index.
+     * @param key the key (case insensitive, does not need to be NULL-Terminated).
+     * @param len the length of the key.
+     *
+     * @returns the index of the parameter or -1 if the command has no such key.
+     */
+    int keyword(int ndx, const char *key, unsigned int len) const
+    {
+        int k = probe(keys[ndx].kslot, keys[ndx].kseed, keys[ndx].kbits, key, len);
+
+        return k < 0 ? -1 : keys[ndx].named + k;
+    }
+
+    /** The default value of a parameter, converted when the table was built.
+     *
+     * @param desc the compiled pattern (with a default, desc.def != 0).
+     *
+     * @returns the value.
+     */
+    const Cmdb::parm &fallback(const Cmdb::parmdesc &desc) const
+    {
+        return defaults[desc.def - 1];
+    }
+
+    /** The number of defaults that did not convert (like %bu=300) when the table was built.
+     *
+     * Their parameters are required instead. CMDB_VALIDATE rejects such
+     * defaults in a constexpr table at compile time.
+     *
+     * @returns the number of defaults that did not convert.
+     */
+    unsigned int errors() const
+    {
+        return failed;
+    }
+
+private:
+    /** Copy of the command table (vector constructor).
+    */
+    std::vector<cmd> store;
+
+    /** The command table.
+    */
+    const cmd *tbl;
+
+    /** The number of commands in tbl.
+    */
+    unsigned int count;
+
+    /** Predefined commands appended after tbl (array constructors only).
+    */
+    std::vector<const cmd *> extra;
+
+    /** Appends the predefined commands missing from tbl to extra.
+    */
+    void builtins();
+
+    /** A compile-time index of tbl (see CmdbIndex).
+    */
+    struct perfect
+    {
+        const unsigned short *slot;         // NULL if there is no compile-time index.
+        const unsigned short *next;
+        const unsigned short *disp;
+        const unsigned short *cidslot;
+        const unsigned short *ciddisp;
+        unsigned int bits;
+        unsigned int bbits;
+    };
+
+    /** The compile-time index of tbl, if any.
+     *
+     * The runtime slots, names and cidslots are then only built for extra.
+    */
+    perfect pre;
+
+    /** Used for indexing the command table.
+     *
+     * One entry per command, in command table order.
+    */
+    struct cmdkey
+    {
+        unsigned int hash;   // FNV-1a hash of the upper-cased command name.
+        unsigned short len;  // Length of the command name.
+        unsigned int name;   // Offset of the upper-cased command name in names.
+        unsigned int sig;    // Offset of the compiled parameter signature in sigs.
+        unsigned char argc;  // Number of parameters in the signature.
+        unsigned char named; // First named parameter (argc if none).
+        unsigned char kbits; // Slot bits of the key hash of the named parameters.
+        unsigned int kslot;  // First slot of the key hash in symbols.
+        unsigned int kseed;  // Seed of the key hash.
+    };
+
+    /** Command Name Hashes and Lengths.
+    */
+    std::vector<cmdkey> keys;
+
+    /** Open addressing (linear probing) hash table of command table indices.
+     *
+     * The size is a power of two, empty slots are -1. As commands are inserted in
+     * table order, commands with the same name are probed in table order too.
+    */
+    std::vector<short> slots;
+
+    /** Upper-cased command names, symbols and keys and the default values, each NULL-Terminated.
+    */
+    std::vector<char> names;
+
+    /** Open addressing (linear probing) hash table of command table indices keyed by cid.
+     *
+     * Same size as slots, empty slots are -1. Consecutive cids map onto consecutive
+     * slots, so dense cid ranges are collision free.
+    */
+    std::vector<short> cidslots;
+
+    /** Compiled Parameter Signatures of all commands.
+    */
+    std::vector<Cmdb::parmdesc> sigs;
+
+    /** A slot of the symbol hash of an enum parameter.
+    */
+    struct symkey
+    {
+        unsigned int name;   // Offset of the upper-cased symbol in names.
+        unsigned char len;   // Length of the symbol.
+        unsigned char ndx;   // Position of the symbol in the pattern + 1, 0 if the slot is empty.
+    };
+
+    /** Perfect hashes of the symbols of all enum parameters and the keys of all named parameters, 1 << bits slots each.
+    */
+    std::vector<symkey> symbols;
+
+    /** Default values of all parameters with one.
+    */
+    std::vector<Cmdb::parm> defaults;
+
+    /** Defaults that did not convert (see errors()).
+    */
+    unsigned int failed;
+
+    /** Builds the perfect hash of the symbols of an enum parameter (or the keys of a command).
+     *
+     * A list with duplicate or empty symbols (or more than 255) gets an empty hash, so no symbol matches.
+     *
+     * @param desc the compiled pattern to set bits, slot and seed of.
+     * @param list the symbols separated by |, like on|off.
+     * @param len the length of the list.
+     */
+    void hashenum(Cmdb::parmdesc &desc, const char *list, unsigned int len);
+
+    /** Looks up a symbol in a perfect hash (see hashenum()).
+     *
+     * @returns the position of the symbol in its list or -1.
+     */
+    int probe(unsigned int slot, unsigned int seed, unsigned int bits, const char *sym, unsigned int len) const;
+
+    /** Builds keys, slots, names, cidslots, sigs, symbols and defaults from the command table (and extra).
+     */
+    void reindex();
+
+    /** Not copyable (tbl may point into store).
+     */
+    CmdbTable(const CmdbTable &);
+    CmdbTable &operator=(const CmdbTable &);
+
+};
+
+
 extern "C" void mbed_reset();
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,186 @@
+/* mbed Command Interpreter Library
+ * Copyright (c) 2016 wvd_vegt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+_____________________________________________________________________________
+
+   Project:     mBed Command Interpreter
+   Filename:    cmdbpool.cpp
+   Version:     0.86
+_____________________________________________________________________________
+   Date         Comment
+   -------- --------------------------------------------------------------
+   18102026 -Created, work stealing thread pool for asynchronous mode.
+_____________________________________________________________________________
+*/
+
+#include "cmdbpool.h"
+
+#if __cplusplus >= 201103L
+
+//------------------------------------------------------------------------------
+
+/** The pool and index of the worker running on this thread (else NULL).
+ */
+static thread_local CmdbPool *current = NULL;
+static thread_local unsigned int currentndx = 0;
+
+//------------------------------------------------------------------------------
+
+CmdbPool::CmdbPool(unsigned int _workers) :
+        next(0), queued(0), peak(0), count(0), steals(0), waited(0), maxwaited(0),
+        sleeping(0), stopping(false) {
+    if (_workers == 0) {
+        _workers = std::thread::hardware_concurrency();
+    }
+    if (_workers == 0) {
+        _workers = 1;
+    }
+
+    for (unsigned int i = 0; i < _workers; i++) {
+        workers.push_back(new worker());
+    }
+
+    //Start the threads after all queues exist (they steal from each other).
+    for (unsigned int i = 0; i < _workers; i++) {
+        workers[i]->thread = std::thread(&CmdbPool::work, this, i);
+    }
+}
+
+CmdbPool::~CmdbPool() {
+    {
+        std::lock_guard<std::mutex> guard(idle);
+
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        workers[i]->thread.join();
+        delete workers[i];
+    }
+}
+
+void  CmdbPool::submit(Cmdb &cmdb) {
+    //Counted before it is queued, so depth() never wraps below zero.
+    unsigned int d = ++queued;
+    unsigned int p = peak;
+
+    while (d > p && !peak.compare_exchange_weak(p, d)) {
+    }
+
+    //Keep the work of a worker local, spread the rest.
+    unsigned int ndx = (current == this) ? currentndx : next++ % workers.size();
+
+    job j = { &cmdb, std::chrono::steady_clock::now() };
+
+    {
+        std::lock_guard<std::mutex> guard(workers[ndx]->lock);
+
+        workers[ndx]->jobs.push_back(j);
+    }
+
+    //A sleeping worker either sees queued or is woken (both are sequentially consistent).
+    if (sleeping > 0) {
+        {
+            std::lock_guard<std::mutex> guard(idle);
+        }
+        wake.notify_one();
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void  CmdbPool::work(unsigned int self) {
+    current    = this;
+    currentndx = self;
+
+    for (;;) {
+        job j;
+
+        if (take(self, j)) {
+            run(j);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idle);
+
+        sleeping++;
+        while (queued == 0 && !stopping) {
+            wake.wait(lock);
+        }
+        sleeping--;
+
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+bool  CmdbPool::take(unsigned int self, job &j) {
+    unsigned int n = workers.size();
+
+    {
+        worker &w = *workers[self];
+        std::lock_guard<std::mutex> guard(w.lock);
+
+        if (!w.jobs.empty()) {
+            j = w.jobs.front();
+            w.jobs.pop_front();
+            queued--;
+
+            return true;
+        }
+    }
+
+    //Steal from the other end, away from the owner.
+    for (unsigned int i = 1; i < n; i++) {
+        worker &v = *workers[(self + i) % n];
+        std::lock_guard<std::mutex> guard(v.lock);
+
+        if (!v.jobs.empty()) {
+            j = v.jobs.back();
+            v.jobs.pop_back();
+            queued--;
+            steals++;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void  CmdbPool::run(const job &j) {
+    unsigned long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - j.submitted).count();
+    unsigned long long m = maxwaited;
+
+    while (us > m && !maxwaited.compare_exchange_weak(m, us)) {
+    }
+    waited += us;
+    count++;
+
+    j.cmdb->execute();
+}
+
+#endif
@@ -0,0 +1,173 @@
+/* mbed Command Interpreter Library
+ * Copyright (c) 2016 wvd_vegt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MBED_CMDBPOOL_H
+#define MBED_CMDBPOOL_H
+
+#include "cmdb.h"
+
+#if __cplusplus >= 201103L
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------
+
+/** Work stealing thread pool running the commands of Cmdb instances in asynchronous mode.
+ *
+ * Every worker has its own queue. Commands submitted by a worker go to its own
+ * queue, others are spread round robin. A worker with an empty queue steals
+ * from the others before it sleeps.
+ *
+ * As a Cmdb submits its next command only after the previous one completed,
+ * the commands of each instance still run in order.
+ *
+ * Usage: CmdbPool pool(4); cmdb.async(&pool);
+ */
+class CmdbPool : public CmdbExecutor
+{
+public:
+    /** Create a Pool.
+     *
+     * @param workers the number of worker threads (0 for one per core).
+     */
+    CmdbPool(unsigned int workers = 0);
+
+    /** Runs the remaining commands and stops the workers.
+     */
+    ~CmdbPool();
+
+    /** Queues a command (see CmdbExecutor).
+     *
+     * @param cmdb the interpreter with the command.
+     */
+    virtual void submit(Cmdb &cmdb);
+
+    /** The number of commands waiting for a worker.
+     *
+     * @returns the queue depth.
+     */
+    unsigned int depth() const
+    {
+        return queued;
+    }
+
+    /** The maximum number of commands that were waiting for a worker.
+     *
+     * @returns the queue depth high-water mark.
+     */
+    unsigned int highwater() const
+    {
+        return peak;
+    }
+
+    /** The number of commands run.
+     *
+     * @returns the number of commands.
+     */
+    unsigned long long executed() const
+    {
+        return count;
+    }
+
+    /** The number of commands run by a worker that it stole from another.
+     *
+     * @returns the number of stolen commands.
+     */
+    unsigned long long stolen() const
+    {
+        return steals;
+    }
+
+    /** The total time commands spent waiting for a worker.
+     *
+     * @returns the time in microseconds.
+     */
+    unsigned long long queuedtime() const
+    {
+        return waited;
+    }
+
+    /** The longest time a command spent waiting for a worker.
+     *
+     * @returns the time in microseconds.
+     */
+    unsigned long long maxqueuedtime() const
+    {
+        return maxwaited;
+    }
+
+private:
+    /** A queued command.
+     */
+    struct job {
+        Cmdb *cmdb;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    /** A worker thread with its queue.
+     */
+    struct worker {
+        std::mutex lock;
+        std::deque<job> jobs;
+        std::thread thread;
+    };
+
+    /** Runs commands until the pool is destroyed.
+     */
+    void work(unsigned int self);
+
+    /** Takes the oldest job of a worker's own queue, else steals the newest of another.
+     *
+     * @returns false if all queues are empty.
+     */
+    bool take(unsigned int self, job &j);
+
+    /** Updates the statistics and runs a job.
+     */
+    void run(const job &j);
+
+    std::vector<worker *> workers;
+
+    std::atomic<unsigned int> next;     // Round robin for submit() from other threads.
+
+    std::atomic<unsigned int> queued;
+    std::atomic<unsigned int> peak;
+    std::atomic<unsigned long long> count;
+    std::atomic<unsigned long long> steals;
+    std::atomic<unsigned long long> waited;
+    std::atomic<unsigned long long> maxwaited;
+
+    std::mutex idle;                    // Guards sleeping workers.
+    std::condition_variable wake;
+    std::atomic<unsigned int> sleeping;
+    bool stopping;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,647 @@
+/* mbed Command Interpreter Library
+ * Copyright (c) 2016 wvd_vegt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+_____________________________________________________________________________
+
+   Project:     mBed Command Interpreter
+   Filename:    cmdbserver.cpp
+   Version:     0.86
+_____________________________________________________________________________
+   Date         Comment
+   -------- --------------------------------------------------------------
+   18102026 -Created, epoll based multi-session server for Linux hosts.
+            -Added async(), sessions hold their input while a command runs on
+             the executor and are resumed by completed().
+_____________________________________________________________________________
+*/
+
+#include "cmdbserver.h"
+
+#if defined(__linux__) && __cplusplus >= 201103L
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+//------------------------------------------------------------------------------
+
+/** A connection with its interpreter.
+ *
+ * Output is sent directly while the socket accepts it, the remainder is
+ * queued (up to MAX_SESSION_TX) and sent on EPOLLOUT.
+ *
+ * In asynchronous mode the session is its interpreter's executor and forwards
+ * commands to the server's. While busy the worker owns the interpreter and
+ * output, the loop only notes hangups until completed().
+ */
+struct CmdbServer::session : public CmdbTransport, public CmdbExecutor {
+    int fd;
+    std::string pending;                // Unsent output (from sent on).
+    size_t sent;
+    std::string input;                  // Unprocessed input (at most one read), waiting for pending to drain.
+    bool failed;                        // Write error or output overflow.
+    unsigned int events;                // Current epoll interest.
+    session *prev;                      // Sessions of the loop (for stop()).
+    session *next;
+    loop *owner;
+    CmdbExecutor *executor;             // The server's executor.
+    bool busy;                          // A command is queued or running (owned by the loop).
+    bool hungup;                        // Hangup seen while busy.
+
+    Cmdb cmdb;                          // Last, it prints a prompt when constructed.
+
+    session(int _fd, const CmdbTable &table, void (*callback)(Cmdb &, int)) :
+        fd(_fd), sent(0), failed(false), events(EPOLLIN), prev(NULL), next(NULL),
+        owner(NULL), executor(NULL), busy(false), hungup(false),
+        cmdb(this, table, callback) {}
+
+    ~session() {
+        ::close(fd);
+    }
+
+    //Input is pushed into cmdb by the loop.
+    virtual int readable() {
+        return 0;
+    }
+
+    virtual int read(char *buf, unsigned int len) {
+        (void)buf;
+        (void)len;
+
+        return 0;
+    }
+
+    virtual int write(const char *buf, unsigned int len) {
+        ssize_t n = 0;
+
+        if (failed) {
+            return -1;
+        }
+
+        if (sent == pending.size()) {
+            n = ::send(fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    failed = true;
+                    return -1;
+                }
+                n = 0;
+            }
+        }
+
+        if ((size_t)n < len) {
+            if (pending.size() - sent + (len - n) > MAX_SESSION_TX) {
+                failed = true;
+                return -1;
+            }
+            pending.append(buf + n, len - n);
+        }
+
+        return len;
+    }
+
+    //Called by cmdb.scan() on the loop.
+    virtual void submit(Cmdb &_cmdb) {
+        busy = true;
+        executor->submit(_cmdb);
+    }
+
+    /** The number of bytes of output waiting to be sent.
+     */
+    size_t queued() {
+        return pending.size() - sent;
+    }
+
+    /** Sends queued output.
+     */
+    void drain() {
+        while (!failed && sent < pending.size()) {
+            ssize_t n = ::send(fd, pending.data() + sent, pending.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    failed = true;
+                }
+                break;
+            }
+            sent += n;
+        }
+
+        if (sent == pending.size()) {
+            //Release the memory of large bursts.
+            std::string().swap(pending);
+            sent = 0;
+        }
+    }
+};
+
+/** An event loop with its own epoll instance (and TCP listener).
+ */
+struct CmdbServer::loop {
+    int ep;
+    int tcpfd;                          // SO_REUSEPORT listener of this loop or -1.
+    int wakefd;                         // eventfd signalled by stop() and completed().
+    std::thread thread;
+    std::atomic<unsigned long long> commands;
+    std::atomic<unsigned int> sessions;
+    session *first;                     // Open sessions.
+    std::mutex lock;                    // Guards done.
+    std::vector<session *> done;        // Sessions whose command completed.
+
+    loop() : ep(-1), tcpfd(-1), wakefd(-1), commands(0), sessions(0), first(NULL) {}
+};
+
+//------------------------------------------------------------------------------
+
+CmdbServer::CmdbServer(const CmdbTable &_table, void (*_callback)(Cmdb &, int), unsigned int _loops) :
+        table(_table), callback(_callback), unixfd(-1), tn(false), executor(NULL), stopping(false) {
+    if (_loops == 0) {
+        _loops = std::thread::hardware_concurrency();
+    }
+    if (_loops == 0) {
+        _loops = 1;
+    }
+
+    for (unsigned int i = 0; i < _loops; i++) {
+        loop *l = new loop();
+
+        l->ep     = epoll_create1(EPOLL_CLOEXEC);
+        l->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        epoll_event ev = {};
+
+        ev.events   = EPOLLIN;
+        ev.data.ptr = &l->wakefd;
+        epoll_ctl(l->ep, EPOLL_CTL_ADD, l->wakefd, &ev);
+
+        loops.push_back(l);
+    }
+}
+
+CmdbServer::~CmdbServer() {
+    for (unsigned int i = 0; i < loops.size(); i++) {
+        loop *l = loops[i];
+
+        if (l->tcpfd != -1) {
+            ::close(l->tcpfd);
+        }
+        ::close(l->wakefd);
+        ::close(l->ep);
+
+        delete l;
+    }
+
+    if (unixfd != -1) {
+        ::close(unixfd);
+        unlink(unixpath.c_str());
+    }
+}
+
+bool  CmdbServer::listen_tcp(unsigned short port) {
+    for (unsigned int i = 0; i < loops.size(); i++) {
+        loop *l = loops[i];
+        int one = 1;
+
+        int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if (fd == -1) {
+            return false;
+        }
+
+        sockaddr_in6 addr = {};
+
+        addr.sin6_family = AF_INET6;
+        addr.sin6_port   = htons(port);
+        addr.sin6_addr   = in6addr_any;
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+        if (bind(fd, (sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+            int err = errno;
+
+            ::close(fd);
+            errno = err;
+
+            return false;
+        }
+
+        epoll_event ev = {};
+
+        ev.events   = EPOLLIN;
+        ev.data.ptr = &l->tcpfd;
+        epoll_ctl(l->ep, EPOLL_CTL_ADD, fd, &ev);
+
+        l->tcpfd = fd;
+    }
+
+    return true;
+}
+
+bool  CmdbServer::listen_unix(const char *path) {
+    sockaddr_un addr = {};
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    unlink(path);
+
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        int err = errno;
+
+        ::close(fd);
+        errno = err;
+
+        return false;
+    }
+
+    //Only one loop is woken per connection.
+    for (unsigned int i = 0; i < loops.size(); i++) {
+        epoll_event ev = {};
+
+        ev.events   = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = &unixfd;
+        epoll_ctl(loops[i]->ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    unixfd   = fd;
+    unixpath = path;
+
+    return true;
+}
+
+void  CmdbServer::run() {
+    for (unsigned int i = 1; i < loops.size(); i++) {
+        loops[i]->thread = std::thread(&CmdbServer::serve, this, std::ref(*loops[i]));
+    }
+
+    serve(*loops[0]);
+
+    for (unsigned int i = 1; i < loops.size(); i++) {
+        loops[i]->thread.join();
+    }
+}
+
+void  CmdbServer::stop() {
+    stopping = true;
+
+    for (unsigned int i = 0; i < loops.size(); i++) {
+        uint64_t one = 1;
+
+        //write() is async-signal-safe.
+        if (::write(loops[i]->wakefd, &one, sizeof(one)) < 0) {
+            continue;
+        }
+    }
+}
+
+unsigned long long  CmdbServer::commands() const {
+    unsigned long long sum = 0;
+
+    for (unsigned int i = 0; i < loops.size(); i++) {
+        sum += loops[i]->commands;
+    }
+
+    return sum;
+}
+
+unsigned int  CmdbServer::sessions() const {
+    unsigned int sum = 0;
+
+    for (unsigned int i = 0; i < loops.size(); i++) {
+        sum += loops[i]->sessions;
+    }
+
+    return sum;
+}
+
+//------------------------------------------------------------------------------
+
+void  CmdbServer::serve(loop &l) {
+    epoll_event events[256];
+    char rx[MAX_SESSION_RX];
+
+    for (;;) {
+        int n = epoll_wait(l.ep, events, sizeof(events) / sizeof(events[0]), -1);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        bool woken = false;
+
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+
+            if (ptr == &l.wakefd) {
+                //Handled after this batch, it may close sessions that are in it.
+                woken = true;
+                continue;
+            }
+
+            if (stopping) {
+                continue;
+            }
+
+            if (ptr == &l.tcpfd) {
+                accept_all(l, l.tcpfd, true);
+                continue;
+            }
+
+            if (ptr == &unixfd) {
+                accept_all(l, unixfd, false);
+                continue;
+            }
+
+            session *s = static_cast<session *>(ptr);
+
+            if (s->busy) {
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    s->hungup = true;
+                }
+                continue;
+            }
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                s->failed = true;
+            }
+
+            if (!s->failed && (events[i].events & EPOLLOUT)) {
+                s->drain();
+
+                //Resume the input that was held back.
+                if (!s->input.empty() && s->queued() < MAX_SESSION_TX / 2) {
+                    std::string held;
+
+                    held.swap(s->input);
+                    feed(l, s, held.data(), held.size());
+                }
+            }
+
+            if (!s->busy && !s->failed && (events[i].events & EPOLLIN)) {
+                ssize_t len = ::recv(s->fd, rx, sizeof(rx), 0);
+
+                if (len > 0) {
+                    feed(l, s, rx, len);
+                } else if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    s->failed = true;
+                }
+            }
+
+            update(l, s);
+        }
+
+        if (woken && !wakeup(l)) {
+            return;
+        }
+    }
+}
+
+bool  CmdbServer::wakeup(loop &l) {
+    uint64_t cnt;
+    std::vector<session *> ready;
+
+    if (::read(l.wakefd, &cnt, sizeof(cnt)) < 0) {
+        //Already reset.
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(l.lock);
+
+        ready.swap(l.done);
+    }
+
+    for (unsigned int i = 0; i < ready.size(); i++) {
+        session *s = ready[i];
+
+        //completed() runs just before execute() clears busy(), wait for that before feeding input.
+        while (s->cmdb.busy()) {
+            std::this_thread::yield();
+        }
+
+        s->busy = false;
+        if (s->hungup) {
+            s->failed = true;
+        }
+
+        //Resume the input that was held back.
+        if (!s->failed && !s->input.empty() && s->queued() < MAX_SESSION_TX / 2) {
+            std::string held;
+
+            held.swap(s->input);
+            feed(l, s, held.data(), held.size());
+        }
+
+        update(l, s);
+    }
+
+    if (stopping) {
+        //Stopped, close all sessions of this loop that are not running a command.
+        session *s = l.first;
+
+        while (s) {
+            session *next = s->next;
+
+            if (!s->busy) {
+                close(l, s);
+            }
+            s = next;
+        }
+
+        return l.first != NULL;
+    }
+
+    return true;
+}
+
+void  CmdbServer::completed(Cmdb &cmdb, void *context) {
+    session *s = static_cast<session *>(context);
+    loop &l = *s->owner;
+    uint64_t one = 1;
+
+    (void)cmdb;
+
+    {
+        std::lock_guard<std::mutex> guard(l.lock);
+
+        l.done.push_back(s);
+    }
+
+    if (::write(l.wakefd, &one, sizeof(one)) < 0) {
+        //The counter only overflows after 2^64 - 1 writes.
+    }
+}
+
+void  CmdbServer::accept_all(loop &l, int fd, bool tcp) {
+    for (;;) {
+        int cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (cfd == -1) {
+            //EAGAIN, or out of descriptors (retried on the next connection).
+            return;
+        }
+
+        if (tcp) {
+            int one = 1;
+
+            setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+
+        session *s = new session(cfd, table, callback);
+
+        s->owner = &l;
+
+        if (tcp && tn) {
+            s->cmdb.telnet();
+        }
+
+        if (executor) {
+            s->executor = executor;
+            s->cmdb.async(s, completed, s);
+        }
+
+        s->next = l.first;
+        if (l.first) {
+            l.first->prev = s;
+        }
+        l.first = s;
+
+        epoll_event ev = {};
+
+        ev.events   = s->events;
+        ev.data.ptr = s;
+        epoll_ctl(l.ep, EPOLL_CTL_ADD, cfd, &ev);
+
+        l.sessions++;
+
+        //Send what did not fit (the prompt).
+        update(l, s);
+    }
+}
+
+void  CmdbServer::feed(loop &l, session *s, const char *buf, unsigned int len) {
+    unsigned int ofs = 0;
+
+    //A line at a time, so input is held back as soon as the client falls behind or a command is queued.
+    while (ofs < len) {
+        const char *cr = (const char *)memchr(buf + ofs, '\r', len - ofs);
+        unsigned int end = cr ? (cr - buf) + 1 : len;
+
+        l.commands += s->cmdb.scan(buf + ofs, end - ofs);
+        ofs = end;
+
+        if (s->busy) {
+            //The output belongs to the worker now.
+            s->input.append(buf + ofs, len - ofs);
+            break;
+        }
+
+        if (s->failed) {
+            break;
+        }
+
+        if (s->queued() >= MAX_SESSION_TX / 2) {
+            s->input.append(buf + ofs, len - ofs);
+            break;
+        }
+    }
+}
+
+void  CmdbServer::update(loop &l, session *s) {
+    if (s->busy) {
+        //Only report a hangup (once), input is held and the worker sends the output.
+        if (s->events != EPOLLET) {
+            epoll_event ev = {};
+
+            ev.events   = EPOLLET;
+            ev.data.ptr = s;
+            epoll_ctl(l.ep, EPOLL_CTL_MOD, s->fd, &ev);
+
+            s->events = EPOLLET;
+        }
+        return;
+    }
+
+    if (s->failed) {
+        close(l, s);
+        return;
+    }
+
+    size_t queued = s->queued();
+
+    //Stop reading while the client does not keep up with the output.
+    bool reading = s->input.empty() && queued < MAX_SESSION_TX / 2;
+
+    unsigned int events = (queued ? (unsigned int)EPOLLOUT : 0u) | (reading ? (unsigned int)EPOLLIN : 0u);
+
+    if (events != s->events) {
+        epoll_event ev = {};
+
+        ev.events   = events;
+        ev.data.ptr = s;
+        epoll_ctl(l.ep, EPOLL_CTL_MOD, s->fd, &ev);
+
+        s->events = events;
+    }
+}
+
+void  CmdbServer::close(loop &l, session *s) {
+    epoll_ctl(l.ep, EPOLL_CTL_DEL, s->fd, NULL);
+
+    if (s->prev) {
+        s->prev->next = s->next;
+    } else {
+        l.first = s->next;
+    }
+    if (s->next) {
+        s->next->prev = s->prev;
+    }
+
+    l.sessions--;
+
+    delete s;
+}
+
+#endif
@@ -0,0 +1,201 @@
+/* mbed Command Interpreter Library
+ * Copyright (c) 2016 wvd_vegt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MBED_CMDBSERVER_H
+#define MBED_CMDBSERVER_H
+
+#include "cmdb.h"
+
+#if defined(__linux__) && __cplusplus >= 201103L
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------
+
+/** Max unsent output of a session.
+ *
+ * A session stops processing input at half this size and is closed when a
+ * single command produces more output than fits.
+ */
+#ifndef MAX_SESSION_TX
+#define MAX_SESSION_TX 65536
+#endif
+
+/** Size of the receive buffer of an event loop (shared by its sessions).
+ */
+#ifndef MAX_SESSION_RX
+#define MAX_SESSION_RX 4096
+#endif
+
+//------------------------------------------------------------------------------
+
+/** Linux server running a Cmdb session per TCP or Unix socket connection.
+ *
+ * Every event loop has its own epoll instance and thread. TCP connections are
+ * spread over the loops by the kernel (a SO_REUSEPORT listener per loop), Unix
+ * socket connections are accepted by whichever loop wakes first (EPOLLEXCLUSIVE).
+ *
+ * All sessions share the (read-only) command table and dispatcher. With async()
+ * application commands run on an executor (like CmdbPool), so a slow command
+ * only holds the input of its own session.
+ *
+ * Usage: CmdbServer server(table, dispatch); server.listen_tcp(2323); server.run();
+ */
+class CmdbServer
+{
+public:
+    /** Create a Server.
+     *
+     * @param table the command table shared by all sessions.
+     * @param callback the command dispatcher (called on the thread of the session's loop).
+     * @param loops the number of event loops (0 for one per core).
+     */
+    CmdbServer(const CmdbTable &_table, void (*_callback)(Cmdb &, int), unsigned int _loops = 0);
+
+    ~CmdbServer();
+
+    /** Listens on a TCP port (all interfaces).
+     *
+     * @param port the port.
+     *
+     * @returns false on failure (see errno).
+     */
+    bool listen_tcp(unsigned short port);
+
+    /** Listens on a Unix socket (an existing socket file is replaced).
+     *
+     * @param path the socket file.
+     *
+     * @returns false on failure (see errno).
+     */
+    bool listen_unix(const char *path);
+
+    /** Makes TCP sessions speak telnet (see Cmdb::telnet()), call before run().
+     *
+     * @param on true to negotiate telnet options on new TCP connections.
+     */
+    void telnet(bool on)
+    {
+        tn = on;
+    }
+
+    /** Runs application commands of new sessions on an executor (see Cmdb::async()), call before run().
+     *
+     * The input of a session is held while its command is queued or running.
+     *
+     * @param _executor the executor (NULL to run commands on the event loops).
+     */
+    void async(CmdbExecutor *_executor)
+    {
+        executor = _executor;
+    }
+
+    /** Runs the event loops, the first one on the calling thread.
+     *
+     * Returns after stop().
+     */
+    void run();
+
+    /** Makes run() return (may be called from any thread or a signal handler).
+     *
+     * Sessions running a command are closed when it completes.
+     */
+    void stop();
+
+    /** The number of commands (complete lines) processed by all sessions.
+     *
+     * @returns the number of commands.
+     */
+    unsigned long long commands() const;
+
+    /** The number of open sessions.
+     *
+     * @returns the number of sessions.
+     */
+    unsigned int sessions() const;
+
+private:
+    struct session;
+    struct loop;
+
+    /** Runs a single event loop until stop().
+     */
+    void serve(loop &l);
+
+    /** Accepts all pending connections of a listener.
+     */
+    void accept_all(loop &l, int fd, bool tcp);
+
+    /** Scans input a line at a time, holding back the rest when output piles up.
+     */
+    void feed(loop &l, session *s, const char *buf, unsigned int len);
+
+    /** Updates the epoll interest and closes failed sessions.
+     */
+    void update(loop &l, session *s);
+
+    /** Closes a session.
+     */
+    void close(loop &l, session *s);
+
+    /** Resumes sessions whose command completed and handles stop().
+     *
+     * @returns false if the loop is stopped.
+     */
+    bool wakeup(loop &l);
+
+    /** Hands a session whose command completed back to its loop (see Cmdb::async()).
+     */
+    static void completed(Cmdb &cmdb, void *context);
+
+    const CmdbTable &table;
+
+    void (*callback)(Cmdb &, int);
+
+    std::vector<loop *> loops;
+
+    /** The Unix socket listener (shared by all loops) or -1.
+    */
+    int unixfd;
+
+    /** True if TCP sessions speak telnet.
+    */
+    bool tn;
+
+    /** Executor of application commands or NULL.
+    */
+    CmdbExecutor *executor;
+
+    /** Set by stop().
+    */
+    std::atomic<bool> stopping;
+
+    std::string unixpath;
+};
+
+#endif
+
+#endif
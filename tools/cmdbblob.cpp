@@ -0,0 +1,201 @@
+/* mbed Command Interpreter Library
+ * Copyright (c) 2016 wvd_vegt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Blob parameter benchmark.
+ *
+ * Feeds Write (%H) and Put (%B) commands with random payloads through
+ * Cmdb::scan() on a CmdbMemory transport, checks the decoded bytes and
+ * reports the decode throughput in decoded MB/s (end to end, including
+ * echo, parsing and dispatch).
+ *
+ * Usage: cmdbblob [-s bytes] [-d seconds]
+ *
+ * Build: g++ -O2 -std=c++14 -DMAX_CMD_LEN=16384 -I.. cmdbblob.cpp ../cmdb.cpp -o cmdbblob
+ */
+
+#if !defined(__MBED__)
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cmdb.h"
+
+typedef std::chrono::steady_clock clk;
+
+enum {
+    CID_WRITE = 1,
+    CID_PUT
+};
+
+static std::vector<unsigned char> payload;
+static unsigned long long decoded = 0;
+static bool failed = false;
+
+static void check(CmdbSpan<unsigned char> blob) {
+    if (blob.size() != payload.size() || memcmp(blob.data(), &payload[0], blob.size()) != 0) {
+        failed = true;
+    }
+    decoded += blob.size();
+}
+
+static void write_hex(Cmdb &cmdb, CmdbSpan<unsigned char> blob) {
+    (void)cmdb;
+    check(blob);
+}
+
+static void put_base64(Cmdb &cmdb, CmdbSpan<unsigned char> blob) {
+    (void)cmdb;
+    check(blob);
+}
+
+static constexpr cmd cmds[] = {
+    CMDB_CMD("Write", GLOBALCMD, CID_WRITE, "%H", "Write a hex blob", "bytes", write_hex),
+    CMDB_CMD("Put", GLOBALCMD, CID_PUT, "%B", "Write a base64 blob", "bytes", put_base64),
+};
+
+CMDB_VALIDATE(cmds);
+
+static void dispatch(Cmdb &cmdb, int cid) {
+    (void)cmdb;
+    (void)cid;
+}
+
+static std::string hex(const std::vector<unsigned char> &data) {
+    static const char digits[] = "0123456789abcdef";
+    std::string s;
+
+    for (size_t i = 0; i < data.size(); i++) {
+        s += digits[data[i] >> 4];
+        s += digits[data[i] & 15];
+    }
+
+    return s;
+}
+
+static std::string base64(const std::vector<unsigned char> &data) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string s;
+    size_t i;
+
+    for (i = 0; i + 3 <= data.size(); i += 3) {
+        unsigned long v = ((unsigned long)data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+
+        s += digits[(v >> 18) & 63];
+        s += digits[(v >> 12) & 63];
+        s += digits[(v >> 6) & 63];
+        s += digits[v & 63];
+    }
+
+    if (i < data.size()) {
+        unsigned long v = (unsigned long)data[i] << 16;
+
+        if (i + 1 < data.size()) {
+            v |= data[i + 1] << 8;
+        }
+
+        s += digits[(v >> 18) & 63];
+        s += digits[(v >> 12) & 63];
+        s += (i + 1 < data.size()) ? digits[(v >> 6) & 63] : '=';
+        s += '=';
+    }
+
+    return s;
+}
+
+/** Scans line for the given time, returns the decoded MB/s.
+ */
+static double run(Cmdb &cmdb, CmdbMemory &port, const std::string &line, double seconds) {
+    unsigned long long lines = 0;
+
+    decoded = 0;
+
+    clk::time_point start = clk::now();
+    double elapsed;
+
+    do {
+        for (int i = 0; i < 64; i++) {
+            port.output.clear();
+            cmdb.scan(line.c_str(), line.size());
+        }
+        lines += 64;
+        elapsed = std::chrono::duration<double>(clk::now() - start).count();
+    } while (elapsed < seconds);
+
+    if (decoded != lines * payload.size()) {
+        failed = true;
+    }
+
+    return decoded / elapsed / 1e6;
+}
+
+int main(int argc, char **argv) {
+    unsigned int size = 4096;
+    double seconds = 1.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:d:")) != -1) {
+        switch (opt) {
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'd':
+                seconds = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s bytes] [-d seconds]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (size == 0 || 6 + 2 * size > MAX_CMD_LEN) {
+        fprintf(stderr, "a hex line of %u bytes does not fit in MAX_CMD_LEN (%d)\n", size, MAX_CMD_LEN);
+        return 1;
+    }
+
+    payload.resize(size);
+    srand(1);
+    for (unsigned int i = 0; i < size; i++) {
+        payload[i] = rand() & 0xFF;
+    }
+
+    static CmdbTable table(cmds);
+    CmdbMemory port;
+    Cmdb cmdb(&port, table, dispatch);
+
+    std::string write_line = "Write " + hex(payload) + "\r";
+    std::string put_line   = "Put " + base64(payload) + "\r";
+
+    double hex_mbs = run(cmdb, port, write_line, seconds);
+    double b64_mbs = run(cmdb, port, put_line, seconds);
+
+    printf("%u byte blobs: hex %.1f MB/s, base64 %.1f MB/s (decoded)%s\n",
+           size, hex_mbs, b64_mbs, failed ? ", DECODE ERRORS" : "");
+
+    return failed ? 1 : 0;
+}
+
+#endif
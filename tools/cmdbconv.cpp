@@ -0,0 +1,384 @@
+/* mbed Command Interpreter Library
+ * Copyright (c) 2016 wvd_vegt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Conversion benchmark.
+ *
+ * Times commands with a %d, %hx and %f parameter against the same command
+ * with a %s parameter (no conversion) and against a %s command that does the
+ * conversion itself with strtol/strtoul/strtod and a range check, the way
+ * parse() used to. The differences are the cost of the conversion kernels
+ * and of the libc path.
+ *
+ * With -c it instead feeds boundary values through a command of every
+ * cardinal pattern (%bd ... %lx) and %f and checks the result, or the
+ * rejection, against strtol/strtoul/strtod plus a range check.
+ *
+ * Usage: cmdbconv [-n lines] [-c]
+ *
+ * Build: g++ -O2 -std=c++11 -I.. cmdbconv.cpp ../cmdb.cpp -o cmdbconv
+ */
+
+#if !defined(__MBED__)
+
+#include <chrono>
+#include <limits>
+#include <string>
+
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cmdb.h"
+
+typedef std::chrono::steady_clock clk;
+
+//Command ids are the index in cmds[], the cardinal patterns first.
+enum {
+    CID_BD, CID_HD, CID_D, CID_LD,
+    CID_BU, CID_HU, CID_U, CID_LU,
+    CID_BO, CID_HO, CID_O, CID_LO,
+    CID_BX, CID_HX, CID_X, CID_LX,
+    CID_F,
+    CID_S,
+    CID_SD, CID_SHX, CID_SF
+};
+
+static const cmd cmds[] = {
+    {"bd", GLOBALCMD, CID_BD, "%bd", "", "v", NULL},
+    {"hd", GLOBALCMD, CID_HD, "%hd", "", "v", NULL},
+    {"d",  GLOBALCMD, CID_D,  "%d",  "", "v", NULL},
+    {"ld", GLOBALCMD, CID_LD, "%ld", "", "v", NULL},
+    {"bu", GLOBALCMD, CID_BU, "%bu", "", "v", NULL},
+    {"hu", GLOBALCMD, CID_HU, "%hu", "", "v", NULL},
+    {"u",  GLOBALCMD, CID_U,  "%u",  "", "v", NULL},
+    {"lu", GLOBALCMD, CID_LU, "%lu", "", "v", NULL},
+    {"bo", GLOBALCMD, CID_BO, "%bo", "", "v", NULL},
+    {"ho", GLOBALCMD, CID_HO, "%ho", "", "v", NULL},
+    {"o",  GLOBALCMD, CID_O,  "%o",  "", "v", NULL},
+    {"lo", GLOBALCMD, CID_LO, "%lo", "", "v", NULL},
+    {"bx", GLOBALCMD, CID_BX, "%bx", "", "v", NULL},
+    {"hx", GLOBALCMD, CID_HX, "%hx", "", "v", NULL},
+    {"x",  GLOBALCMD, CID_X,  "%x",  "", "v", NULL},
+    {"lx", GLOBALCMD, CID_LX, "%lx", "", "v", NULL},
+    {"f",  GLOBALCMD, CID_F,  "%f",  "", "v", NULL},
+    {"s",  GLOBALCMD, CID_S,  "%s",  "", "v", NULL},
+    {"sd", GLOBALCMD, CID_SD, "%s",  "", "v", NULL},
+    {"shx", GLOBALCMD, CID_SHX, "%s", "", "v", NULL},
+    {"sf", GLOBALCMD, CID_SF, "%s",  "", "v", NULL},
+};
+
+static bool dispatched;
+static long long got;
+static float gotf;
+static volatile long sink;
+
+static void dispatch(Cmdb &cmdb, int cid) {
+    char *endptr;
+    long l;
+    unsigned long ul;
+    double d;
+
+    dispatched = true;
+
+    switch (cid) {
+        case CID_BD:
+            got = (signed char)cmdb.BYTEPARM(0);
+            break;
+        case CID_BU: case CID_BO: case CID_BX:
+            got = cmdb.BYTEPARM(0);
+            break;
+        case CID_HD:
+            got = (short)cmdb.WORDPARM(0);
+            break;
+        case CID_HU: case CID_HO: case CID_HX:
+            got = (unsigned short)cmdb.WORDPARM(0);
+            break;
+        case CID_D:
+            got = cmdb.INTPARM(0);
+            break;
+        case CID_U: case CID_O: case CID_X:
+            got = cmdb.UINTPARM(0);
+            break;
+        case CID_LD:
+            got = cmdb.LONGPARM(0);
+            break;
+        case CID_LU: case CID_LO: case CID_LX:
+            got = (long long)cmdb.DWORDPARM(0);
+            break;
+        case CID_F:
+            gotf = cmdb.FLOATPARM(0);
+            break;
+
+        //The libc path, as parse() converted before the kernels.
+        case CID_SD:
+            errno = 0;
+            l = strtol(cmdb.STRINGPARM(0), &endptr, 10);
+            sink += (errno == 0 && *endptr == '\0' && l >= INT_MIN && l <= INT_MAX) ? l : 0;
+            break;
+        case CID_SHX:
+            errno = 0;
+            ul = strtoul(cmdb.STRINGPARM(0), &endptr, 16);
+            sink += (errno == 0 && *endptr == '\0' && ul <= USHRT_MAX) ? ul : 0;
+            break;
+        case CID_SF:
+            d = strtod(cmdb.STRINGPARM(0), &endptr);
+            sink += (*endptr == '\0' && fabs(d) <= FLT_MAX) ? (long)(float)d : 0;
+            break;
+    }
+}
+
+/** Runs a line through cmdb, returns true if it was dispatched.
+ */
+static bool run(Cmdb &cmdb, CmdbMemory &port, const std::string &line) {
+    dispatched = false;
+    port.output.clear();
+    cmdb.scan(line.data(), line.size());
+
+    return dispatched;
+}
+
+//------------------------------------------------------------------------------
+//----Check mode.
+//------------------------------------------------------------------------------
+
+static const char *ints[] = {
+    "0", "-0", "+0", "1", "-1", "+1", "007", "0777", "0800", "12a", "+", "-", "x", "0x", "-0x1",
+    "127", "128", "-128", "-129", "255", "256", "377", "400",
+    "32767", "32768", "-32768", "-32769", "65535", "65536", "077777", "0100000", "0177777", "0200000",
+    "2147483647", "2147483648", "-2147483648", "-2147483649", "4294967295", "4294967296",
+    "017777777777", "020000000000", "037777777777", "040000000000",
+    "9223372036854775807", "9223372036854775808", "-9223372036854775808", "-9223372036854775809",
+    "18446744073709551615", "18446744073709551616", "99999999999999999999999",
+    "777777777777777777777", "1000000000000000000000", "1777777777777777777777", "2000000000000000000000",
+    "7f", "80", "ff", "FF", "0x7f", "0x80", "0xff", "0X100", "-0x80", "-0x81", "7fff", "8000", "ffff", "10000",
+    "7fffffff", "80000000", "ffffffff", "100000000", "-80000000",
+    "7fffffffffffffff", "8000000000000000", "ffffffffffffffff", "10000000000000000", "0xffffffffffffffff",
+    "00000000000000000000000000001", "-00000000000000000000000000128",
+};
+
+static const char *floats[] = {
+    "0", "-0", "1", "-1", "0.5", ".5", "5.", ".", "-.", "1e", "1e+", "1e5x", "e5", "1.5.2",
+    "3.14159", "-314.159e-2", "123456789", "1234567890123", "0.000000000001234567",
+    "1.23456789012345e10", "16777217", "1e22", "1e23", "1e-22", "1e-23",
+    "1e-38", "1.17549435e-38", "1e-40", "1e-45", "-1e-45", "1.4e-45", "1e-46", "1e-400", "-1e-400", "0e999999",
+    "3.4e38", "3.4028234e38", "3.40282347e38", "-3.4028234e38", "3.5e38", "1e39", "-1e39", "1e400",
+    "nan", "inf", "-inf", "infinity", "0x1p3",
+};
+
+/** Expected result of a cardinal pattern, strtol/strtoul plus a range check.
+ */
+template <typename T>
+static bool expect(const char *s, int base, long long &val) {
+    char *endptr;
+
+    errno = 0;
+
+    if (std::numeric_limits<T>::is_signed) {
+        long l = strtol(s, &endptr, base);
+
+        if (errno || endptr == s || *endptr || l < (long)std::numeric_limits<T>::min() || l > (long)std::numeric_limits<T>::max()) {
+            return false;
+        }
+        val = l;
+    } else {
+        unsigned long ul = strtoul(s, &endptr, base);
+
+        //strtoul negates a '-' value, the unsigned patterns reject it.
+        if (strchr(s, '-') || errno || endptr == s || *endptr || ul > (unsigned long)std::numeric_limits<T>::max()) {
+            return false;
+        }
+        val = (long long)ul;
+    }
+
+    return true;
+}
+
+static bool expect(int cid, const char *s, long long &val) {
+    switch (cid) {
+        case CID_BD: return expect<signed char>(s, 10, val);
+        case CID_HD: return expect<short>(s, 10, val);
+        case CID_D:  return expect<int>(s, 10, val);
+        case CID_LD: return expect<long>(s, 10, val);
+        case CID_BU: return expect<unsigned char>(s, 10, val);
+        case CID_HU: return expect<unsigned short>(s, 10, val);
+        case CID_U:  return expect<unsigned int>(s, 10, val);
+        case CID_LU: return expect<unsigned long>(s, 10, val);
+        case CID_BO: return expect<unsigned char>(s, 8, val);
+        case CID_HO: return expect<unsigned short>(s, 8, val);
+        case CID_O:  return expect<unsigned int>(s, 8, val);
+        case CID_LO: return expect<unsigned long>(s, 8, val);
+        case CID_BX: return expect<unsigned char>(s, 16, val);
+        case CID_HX: return expect<unsigned short>(s, 16, val);
+        case CID_X:  return expect<unsigned int>(s, 16, val);
+        case CID_LX: return expect<unsigned long>(s, 16, val);
+    }
+
+    return false;
+}
+
+/** Expected result of %f, (float)strtod of a decimal number within the float range.
+ *
+ * Underflow gives a (signed) zero, nan, inf and hex floats are rejected.
+ */
+static bool expect(const char *s, float &val) {
+    char *endptr;
+    double d = strtod(s, &endptr);
+
+    if (endptr == s || *endptr || strpbrk(s, "nNiIxX") || fabs(d) > FLT_MAX) {
+        return false;
+    }
+
+    val = (float)d;
+
+    return true;
+}
+
+/** Distance in units in the last place.
+ */
+static long ulps(float a, float b) {
+    int ia;
+    int ib;
+
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+
+    //Map the sign-magnitude encoding onto a monotonic integer line.
+    ia = ia < 0 ? INT_MIN - ia : ia;
+    ib = ib < 0 ? INT_MIN - ib : ib;
+
+    return labs((long)ia - (long)ib);
+}
+
+static int check(Cmdb &cmdb, CmdbMemory &port) {
+    int cases = 0;
+    int failed = 0;
+
+    for (int cid = CID_BD; cid <= CID_LX; cid++) {
+        for (unsigned int k = 0; k < sizeof(ints) / sizeof(ints[0]); k++) {
+            long long want = 0;
+            bool ok = expect(cid, ints[k], want);
+            bool done = run(cmdb, port, std::string(cmds[cid].cmdstr) + " " + ints[k] + "\r");
+
+            cases++;
+            if (ok != done || (ok && got != want)) {
+                printf("%%%s %s: got %s %lld, expected %s %lld\n", cmds[cid].cmdstr, ints[k],
+                       done ? "value" : "rejection", done ? got : 0, ok ? "value" : "rejection", want);
+                failed++;
+            }
+        }
+    }
+
+    for (unsigned int k = 0; k < sizeof(floats) / sizeof(floats[0]); k++) {
+        float want = 0;
+        bool ok = expect(floats[k], want);
+        bool done = run(cmdb, port, std::string("f ") + floats[k] + "\r");
+
+        cases++;
+        if (ok != done || (ok && (ulps(gotf, want) > 1 || signbit(gotf) != signbit(want)))) {
+            printf("%%f %s: got %s %.9g, expected %s %.9g\n", floats[k],
+                   done ? "value" : "rejection", done ? gotf : 0, ok ? "value" : "rejection", want);
+            failed++;
+        }
+    }
+
+    printf("%d cases, %d mismatches\n", cases, failed);
+
+    return failed ? 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+//----Timing.
+//------------------------------------------------------------------------------
+
+/** Returns the time per command of line in ns.
+ */
+static double timed(Cmdb &cmdb, CmdbMemory &port, const std::string &line, long n) {
+    if (!run(cmdb, port, line)) {
+        printf("%s: not executed\n", line.c_str());
+        exit(1);
+    }
+
+    clk::time_point start = clk::now();
+
+    for (long k = 0; k < n; k++) {
+        cmdb.scan(line.data(), line.size());
+    }
+
+    return std::chrono::duration<double, std::nano>(clk::now() - start).count() / n;
+}
+
+int main(int argc, char **argv) {
+    long n = 1000000;
+    bool checks = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c")) != -1) {
+        switch (opt) {
+            case 'n':
+                n = atol(optarg);
+                break;
+            case 'c':
+                checks = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n lines] [-c]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    static CmdbTable table(cmds);
+    CmdbMemory port;
+    Cmdb cmdb(&port, table, dispatch);
+
+    cmdb.scan("echo 0\r", 7);
+
+    if (checks) {
+        return check(cmdb, port);
+    }
+
+    static const char *cases[][3] = {
+        {"%d",  "d",  "-1234567"},
+        {"%hx", "hx", "beef"},
+        {"%f",  "f",  "-314.159e-2"},
+    };
+
+    printf("%ld commands each, echo off, ns per command:\n", n);
+
+    for (int k = 0; k < 3; k++) {
+        std::string arg = std::string(" ") + cases[k][2] + "\r";
+        double none = timed(cmdb, port, "s" + arg, n);
+        double kernel = timed(cmdb, port, cases[k][1] + arg, n);
+        double libc = timed(cmdb, port, std::string("s") + cases[k][1] + arg, n);
+
+        printf("%-4s %-12s %%s %.1f, kernel %.1f (+%.1f), strtoX %.1f (+%.1f)\n", cases[k][0], cases[k][2],
+               none, kernel, kernel - none, libc, libc - none);
+    }
+
+    return 0;
+}
+
+#endif
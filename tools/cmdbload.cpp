@@ -0,0 +1,278 @@
+/* mbed Command Interpreter Library
+ * Copyright (c) 2016 wvd_vegt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Load generator for CmdbServer (Linux only).
+ *
+ * Opens a number of sessions, waits for their prompts and then keeps one
+ * command in flight per session. Reports commands/sec and latency percentiles.
+ *
+ * Usage: cmdbload [-t port | -u socket] [-s sessions] [-d seconds] [-j threads] [-c command]
+ *
+ * Build: g++ -O2 -std=c++11 -pthread cmdbload.cpp -o cmdbload
+ */
+
+#if defined(__linux__) && !defined(__MBED__)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef std::chrono::steady_clock clk;
+
+/** A session of the load generator.
+ */
+struct conn {
+    int fd;
+    bool ready;                         // Initial prompt received.
+    clk::time_point sent;
+};
+
+/** Settings and results of a load generator thread.
+ */
+struct worker {
+    unsigned int sessions;
+    std::vector<conn> conns;
+    std::vector<float> latency;         // Microseconds.
+    unsigned long long commands;
+    std::thread thread;
+};
+
+static unsigned short port = 2323;
+static const char *path = NULL;
+static std::string command = "add 1 2\r";
+static char prompt = '>';
+
+static std::atomic<unsigned int> ready(0);
+static std::atomic<bool> go(false);
+static std::atomic<bool> done(false);
+
+static int connect_one() {
+    int fd;
+
+    if (path) {
+        sockaddr_un addr = {};
+
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1 || connect(fd, (sockaddr *)&addr, sizeof(addr)) == -1) {
+            return -1;
+        }
+    } else {
+        sockaddr_in addr = {};
+        int one = 1;
+
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1 || connect(fd, (sockaddr *)&addr, sizeof(addr)) == -1) {
+            return -1;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    return fd;
+}
+
+static void run(worker *w) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    char buf[4096];
+
+    for (unsigned int i = 0; i < w->sessions; i++) {
+        conn c;
+
+        c.fd    = connect_one();
+        c.ready = false;
+
+        if (c.fd == -1) {
+            perror("connect");
+            exit(1);
+        }
+
+        w->conns.push_back(c);
+    }
+
+    for (unsigned int i = 0; i < w->conns.size(); i++) {
+        epoll_event ev = {};
+
+        ev.events   = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, w->conns[i].fd, &ev);
+    }
+
+    bool started = false;
+    epoll_event events[256];
+
+    while (!done) {
+        //Start all sessions at once, after every session (of all threads) got its prompt.
+        if (!started && go) {
+            for (unsigned int i = 0; i < w->conns.size(); i++) {
+                w->conns[i].sent = clk::now();
+                if (write(w->conns[i].fd, command.data(), command.size()) < 0) {
+                    perror("write");
+                    exit(1);
+                }
+            }
+            started = true;
+        }
+
+        int n = epoll_wait(ep, events, 256, 10);
+
+        for (int i = 0; i < n; i++) {
+            conn &c = w->conns[events[i].data.u32];
+            ssize_t len = read(c.fd, buf, sizeof(buf));
+
+            if (len <= 0) {
+                fprintf(stderr, "session closed\n");
+                exit(1);
+            }
+
+            //Count prompts, the command and its output do not contain the prompt character.
+            for (ssize_t j = 0; j < len; j++) {
+                if (buf[j] != prompt) {
+                    continue;
+                }
+
+                if (!c.ready) {
+                    c.ready = true;
+                    ready++;
+                    continue;
+                }
+
+                clk::time_point now = clk::now();
+
+                w->latency.push_back(std::chrono::duration<float, std::micro>(now - c.sent).count());
+                w->commands++;
+
+                c.sent = now;
+                if (!done && write(c.fd, command.data(), command.size()) < 0) {
+                    perror("write");
+                    exit(1);
+                }
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < w->conns.size(); i++) {
+        close(w->conns[i].fd);
+    }
+    close(ep);
+}
+
+int main(int argc, char **argv) {
+    unsigned int sessions = 1;
+    unsigned int threads = 1;
+    double seconds = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:u:s:d:j:c:")) != -1) {
+        switch (opt) {
+            case 't':
+                port = atoi(optarg);
+                break;
+            case 'u':
+                path = optarg;
+                break;
+            case 's':
+                sessions = atoi(optarg);
+                break;
+            case 'd':
+                seconds = atof(optarg);
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'c':
+                command = std::string(optarg) + "\r";
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t port | -u socket] [-s sessions] [-d seconds] [-j threads] [-c command]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (threads > sessions) {
+        threads = sessions;
+    }
+
+    std::vector<worker> workers(threads);
+
+    for (unsigned int i = 0; i < threads; i++) {
+        workers[i].sessions = sessions / threads + (i < sessions % threads ? 1 : 0);
+        workers[i].commands = 0;
+        workers[i].thread   = std::thread(run, &workers[i]);
+    }
+
+    while (ready < sessions) {
+        usleep(1000);
+    }
+
+    clk::time_point start = clk::now();
+
+    go = true;
+    usleep((useconds_t)(seconds * 1e6));
+    done = true;
+
+    double elapsed = std::chrono::duration<double>(clk::now() - start).count();
+
+    std::vector<float> all;
+    unsigned long long commands = 0;
+
+    for (unsigned int i = 0; i < threads; i++) {
+        workers[i].thread.join();
+        all.insert(all.end(), workers[i].latency.begin(), workers[i].latency.end());
+        commands += workers[i].commands;
+    }
+
+    std::sort(all.begin(), all.end());
+
+    if (all.empty()) {
+        printf("no commands completed\n");
+        return 1;
+    }
+
+    printf("sessions %u  commands/sec %.0f  p50 %.1f us  p99 %.1f us  max %.1f us\n",
+           sessions, commands / elapsed,
+           all[all.size() / 2], all[(size_t)(all.size() * 0.99)], all.back());
+
+    return 0;
+}
+
+#endif
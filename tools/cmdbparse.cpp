@@ -0,0 +1,258 @@
+/* mbed Command Interpreter Library
+ * Copyright (c) 2016 wvd_vegt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Parse benchmark.
+ *
+ * Scans a mix of command lines through a 300 command table with echo off
+ * and reports the time per command (scan, lookup, parse and dispatch).
+ *
+ * With -r it also times a re-creation of the parameter handling parse()
+ * used to do for every command: copy cmd.parms, strtok it and the
+ * arguments, derive the modifier, type and base of each pattern and
+ * convert with strtol/strtoul/strtod and range checks. This is only the
+ * step the compiled signatures replace, not a complete old parse().
+ *
+ * Usage: cmdbparse [-n lines] [-r]
+ *
+ * Build: g++ -O2 -std=c++11 -I.. cmdbparse.cpp ../cmdb.cpp -o cmdbparse
+ */
+
+#if !defined(__MBED__)
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cmdb.h"
+
+typedef std::chrono::steady_clock clk;
+
+static const char *sigs[] = {"%i %i", "%bu %hx %f", "%s", "", "%lu %c %i"};
+
+static const char *lines[] = {
+    "cmd295 12345 -678\r",
+    "CMD151 200 beef 3.5\r",
+    "cmd002 hello_world\r",
+    "cmd103\r",
+    "cmd004 4000000 x -1\r",
+};
+
+static volatile long sink;
+
+static void dispatch(Cmdb &, int) {
+    sink++;
+}
+
+/** Per command pattern handling as parse() did it before the signatures were compiled.
+ */
+static int reference(const char *line, const char *parms) {
+    char cmdstr_buf[1 + MAX_CMD_LEN];
+    char argstr_buf[1 + MAX_CMD_LEN];
+    char prmstr_buf[1 + MAX_CMD_LEN];
+    char *toks[MAX_ARGS];
+    char *prms[MAX_ARGS];
+    union {
+        long l;
+        unsigned long ul;
+        float f;
+    } vals[MAX_ARGS];
+    char *tok;
+    char *argsep;
+    char *endptr;
+    int argcnt = 0;
+    int argfnd = 0;
+    int error = 0;
+
+    memset(cmdstr_buf, 0, sizeof(cmdstr_buf));
+    memset(argstr_buf, 0, sizeof(argstr_buf));
+    memset(vals, 0, sizeof(vals));
+
+    strncpy(cmdstr_buf, line, sizeof(cmdstr_buf) - 1);
+
+    argsep = strchr(cmdstr_buf, ' ');
+    if (argsep) {
+        strcpy(argstr_buf, argsep + 1);
+        *argsep = '\0';
+    }
+
+    memset(prmstr_buf, 0, sizeof(prmstr_buf));
+    strncpy(prmstr_buf, parms, sizeof(prmstr_buf) - 1);
+
+    for (tok = strtok(prmstr_buf, " "); tok && argcnt < MAX_ARGS; tok = strtok(NULL, " ")) {
+        prms[argcnt++] = tok;
+    }
+
+    for (tok = argstr_buf[0] ? strtok(argstr_buf, " ") : NULL; tok && argfnd < MAX_ARGS; tok = strtok(NULL, " ")) {
+        toks[argfnd++] = tok;
+    }
+
+    if (argfnd != argcnt) {
+        return -1;
+    }
+
+    for (int i = 0; i < argcnt && error == 0; i++) {
+        char mod = strlen(prms[i]) == 3 ? prms[i][1] : '\0';
+        char typ = prms[i][strlen(prms[i]) - 1];
+        int base = typ == 'o' ? 8 : typ == 'x' ? 16 : 10;
+        long lo = 0;
+        long hi = 0;
+
+        endptr = toks[i];
+
+        switch (typ) {
+            case 'd':
+            case 'i':
+                vals[i].l = strtol(toks[i], &endptr, base);
+                lo = mod == 'b' ? SCHAR_MIN : mod == 'h' ? SHRT_MIN : mod == 'l' ? LONG_MIN : INT_MIN;
+                hi = mod == 'b' ? SCHAR_MAX : mod == 'h' ? SHRT_MAX : mod == 'l' ? LONG_MAX : INT_MAX;
+                if (vals[i].l < lo || vals[i].l > hi) {
+                    error = i + 1;
+                }
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+                vals[i].ul = strtoul(toks[i], &endptr, base);
+                if (vals[i].ul > (mod == 'b' ? UCHAR_MAX : mod == 'h' ? USHRT_MAX : mod == 'l' ? ULONG_MAX : UINT_MAX)) {
+                    error = i + 1;
+                }
+                break;
+            case 'e':
+            case 'f':
+            case 'g':
+                vals[i].f = (float)strtod(toks[i], &endptr);
+                break;
+            case 'c':
+                vals[i].l = toks[i][0];
+                endptr = toks[i] + 1;
+                break;
+            default:
+                endptr = toks[i] + strlen(toks[i]);
+                break;
+        }
+
+        if (error == 0 && (endptr == toks[i] || *endptr)) {
+            error = i + 1;
+        }
+    }
+
+    return error ? -1 : argcnt;
+}
+
+int main(int argc, char **argv) {
+    long n = 200000;
+    bool ref = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r")) != -1) {
+        switch (opt) {
+            case 'n':
+                n = atol(optarg);
+                break;
+            case 'r':
+                ref = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n lines] [-r]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    static char names[300][16];
+    std::vector<cmd> cmds;
+
+    cmds.push_back(ECHO);
+    for (int i = 0; i < 300; i++) {
+        cmd c = {names[i], GLOBALCMD, i, sigs[i % 5], "Benchmark", "", NULL};
+
+        snprintf(names[i], sizeof(names[i]), "Cmd%03d", i);
+        cmds.push_back(c);
+    }
+    cmds.push_back(IDLE);
+    cmds.push_back(HELP);
+
+    static CmdbTable table(cmds);
+    CmdbMemory port;
+    Cmdb cmdb(&port, table, dispatch);
+
+    cmdb.scan("echo 0\r", 7);
+
+    //Every line must execute, an error would time the error path instead.
+    for (int k = 0; k < 5; k++) {
+        port.output.clear();
+        for (const char *p = lines[k]; *p; p++) {
+            cmdb.scan(*p);
+        }
+        if (sink != k + 1) {
+            printf("%s: %s\n", lines[k], port.output.c_str());
+            return 1;
+        }
+    }
+
+    clk::time_point start = clk::now();
+
+    for (long k = 0; k < n; k++) {
+        for (const char *p = lines[k % 5]; *p; p++) {
+            cmdb.scan(*p);
+        }
+        port.output.clear();
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(clk::now() - start).count() / n;
+
+    printf("%ld commands, 300 command table, echo off: %.1f ns per command\n", n, ns);
+
+    if (ref) {
+        //Without the terminating \r, as parse() gets the line.
+        std::string stripped[5];
+        const char *parms[5];
+
+        for (int k = 0; k < 5; k++) {
+            stripped[k] = std::string(lines[k], strlen(lines[k]) - 1);
+            parms[k] = sigs[atoi(lines[k] + 3) % 5];
+            if (reference(stripped[k].c_str(), parms[k]) < 0) {
+                printf("%s: reference rejects it\n", stripped[k].c_str());
+                return 1;
+            }
+        }
+
+        start = clk::now();
+
+        for (long k = 0; k < n; k++) {
+            sink += reference(stripped[k % 5].c_str(), parms[k % 5]);
+        }
+
+        ns = std::chrono::duration<double, std::nano>(clk::now() - start).count() / n;
+
+        printf("reference per command pattern handling (strtok, strtol/strtod): %.1f ns per command\n", ns);
+    }
+
+    return 0;
+}
+
+#endif
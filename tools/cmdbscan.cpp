@@ -0,0 +1,197 @@
+/* mbed Command Interpreter Library
+ * Copyright (c) 2016 wvd_vegt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Bulk input benchmark.
+ *
+ * Feeds the same input to two Cmdb instances, one a character at a time
+ * through scan(c) and one in random chunks through scan(buf, len), and
+ * checks both produce the same output. Then reports the throughput of
+ * both for 1 MiB of 100 character lines (an unknown command, echo on,
+ * output buffered in memory).
+ *
+ * The printable run search uses SSE2 when __SSE2__ is defined, add
+ * -U__SSE2__ to time the word-at-a-time search of other targets.
+ *
+ * Usage: cmdbscan [-r rounds]
+ *
+ * Build: g++ -O2 -std=c++11 -I.. cmdbscan.cpp ../cmdb.cpp -o cmdbscan
+ */
+
+#if !defined(__MBED__)
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cmdb.h"
+
+typedef std::chrono::steady_clock clk;
+
+enum {
+    CID_ADD = 1
+};
+
+static const cmd cmds[] = {
+    {"Add", GLOBALCMD, CID_ADD, "%i %i", "Add two numbers", "a b", NULL},
+};
+
+static void dispatch(Cmdb &cmdb, int cid) {
+    if (cid == CID_ADD) {
+        cmdb.printf("%d\r\n", cmdb.INTPARM(0) + cmdb.INTPARM(1));
+    }
+}
+
+/** Random input with commands, line editing, escape sequences and binary noise.
+ */
+static std::string noise() {
+    std::string in;
+    int n = rand() % 2000;
+
+    for (int k = 0; k < n; k++) {
+        int r = rand() % 100;
+
+        if (r < 3) {
+            in += '\r';
+        } else if (r < 4) {
+            in += '\b';
+        } else if (r < 5) {
+            in += "\033[D";
+        } else if (r < 6) {
+            in += (char)(rand() % 256);
+        } else if (r < 8) {
+            in += "add 1 2\r";
+        } else if (r < 9) {
+            in += "echo 0\r";
+        } else if (r < 10) {
+            in += "echo 1\r";
+        } else {
+            in += (char)(' ' + rand() % 95);
+        }
+    }
+
+    return in;
+}
+
+/** Scans buf rounds times, returns MB/s.
+ */
+static double run(Cmdb &cmdb, CmdbMemory &port, const std::string &buf, int rounds, bool bulk) {
+    clk::time_point start = clk::now();
+
+    for (int r = 0; r < rounds; r++) {
+        port.output.clear();
+
+        if (bulk) {
+            cmdb.scan(buf.data(), buf.size());
+        } else {
+            for (size_t k = 0; k < buf.size(); k++) {
+                cmdb.scan(buf[k]);
+            }
+        }
+    }
+
+    return (double)rounds * buf.size() / std::chrono::duration<double>(clk::now() - start).count() / 1e6;
+}
+
+int main(int argc, char **argv) {
+    int rounds = 20;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+            case 'r':
+                rounds = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-r rounds]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    static CmdbTable table(cmds);
+
+    //Equivalence.
+    srand(1);
+
+    for (int t = 0; t < 300; t++) {
+        std::string in = noise();
+        CmdbMemory one, bulk;
+        Cmdb a(&one, table, dispatch);
+        Cmdb b(&bulk, table, dispatch);
+        int la = 0;
+        int lb = 0;
+
+        for (size_t k = 0; k < in.size(); k++) {
+            la += a.scan(in[k]);
+        }
+
+        for (size_t pos = 0; pos < in.size(); ) {
+            size_t n = 1 + rand() % 300;
+
+            if (pos + n > in.size()) {
+                n = in.size() - pos;
+            }
+
+            lb += b.scan(in.data() + pos, n);
+            pos += n;
+        }
+
+        if (one.output != bulk.output || la != lb) {
+            printf("input %d: scan(buf, len) output differs from scan(c)\n", t);
+            return 1;
+        }
+    }
+
+    //Throughput.
+    std::string line(100, 'a');
+    std::string buf;
+
+    line[5] = ' ';
+    line += '\r';
+
+    while (buf.size() < (1u << 20)) {
+        buf += line;
+    }
+
+    CmdbMemory port;
+    Cmdb cmdb(&port, table, dispatch);
+
+    double single = run(cmdb, port, buf, rounds, false);
+    double bulk   = run(cmdb, port, buf, rounds, true);
+
+    printf("300 random inputs: same output\n");
+    printf("%u KiB of 100 character lines, echo on: scan(c) %.1f MB/s, scan(buf, len) %.1f MB/s (%s search)\n",
+           (unsigned int)(buf.size() >> 10), single, bulk,
+#if defined(__SSE2__)
+           "SSE2"
+#else
+           "word"
+#endif
+          );
+
+    return 0;
+}
+
+#endif
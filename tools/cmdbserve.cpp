@@ -0,0 +1,150 @@
+/* mbed Command Interpreter Library
+ * Copyright (c) 2016 wvd_vegt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Demo server for CmdbServer (Linux only).
+ *
+ * Usage: cmdbserve [-p port] [-u socket] [-l loops] [-T] [-w workers]
+ *
+ * -T negotiates telnet options (line mode) on TCP connections.
+ * -w runs the commands on a pool of worker threads (so Sleep only blocks its own session).
+ *
+ * Build: g++ -O2 -std=c++14 -pthread -I.. cmdbserve.cpp ../cmdb.cpp ../cmdbserver.cpp ../cmdbpool.cpp -o cmdbserve
+ */
+
+#if defined(__linux__) && !defined(__MBED__)
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cmdbserver.h"
+#include "cmdbpool.h"
+
+enum {
+    CID_ADD = 1,
+    CID_NOP,
+    CID_SLEEP
+};
+
+static void add(Cmdb &cmdb, int a, int b) {
+    cmdb.printf("%d\r\n", a + b);
+}
+
+static void nop(Cmdb &cmdb) {
+    (void)cmdb;
+}
+
+static const cmd cmds[] = {
+    CMDB_CMD("Add", GLOBALCMD, CID_ADD, "%i %i", "Add two numbers", "a b", add),
+    CMDB_CMD("Nop", GLOBALCMD, CID_NOP, "", "Does nothing", "", nop),
+    {"Sleep", GLOBALCMD, CID_SLEEP, "%i", "Blocks for a number of milliseconds", "ms", NULL},
+};
+
+static CmdbServer *server = NULL;
+
+//Commands without a handler.
+static void dispatch(Cmdb &cmdb, int cid) {
+    switch (cid) {
+        case CID_SLEEP:
+            usleep(cmdb.INTPARM(0) * 1000);
+            break;
+    }
+}
+
+static void interrupted(int sig) {
+    (void)sig;
+
+    if (server) {
+        server->stop();
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned short port = 2323;
+    const char *path = NULL;
+    unsigned int loops = 0;
+    bool telnet = false;
+    int workers = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:u:l:Tw:")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'u':
+                path = optarg;
+                break;
+            case 'l':
+                loops = atoi(optarg);
+                break;
+            case 'T':
+                telnet = true;
+                break;
+            case 'w':
+                workers = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-p port] [-u socket] [-l loops] [-T] [-w workers]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    static CmdbTable table(cmds);
+    CmdbPool *pool = workers >= 0 ? new CmdbPool(workers) : NULL;
+    CmdbServer srv(table, dispatch, loops);
+
+    srv.telnet(telnet);
+    srv.async(pool);
+
+    if (port && !srv.listen_tcp(port)) {
+        perror("listen_tcp");
+        return 1;
+    }
+
+    if (path && !srv.listen_unix(path)) {
+        perror("listen_unix");
+        return 1;
+    }
+
+    server = &srv;
+
+    signal(SIGINT, interrupted);
+    signal(SIGTERM, interrupted);
+
+    srv.run();
+
+    printf("%llu commands\n", srv.commands());
+
+    if (pool) {
+        printf("pool: %llu run, %llu stolen, depth max %u, queued avg %.1f us max %llu us\n",
+               pool->executed(), pool->stolen(), pool->highwater(),
+               pool->executed() ? (double)pool->queuedtime() / pool->executed() : 0.0, pool->maxqueuedtime());
+
+        delete pool;
+    }
+
+    return 0;
+}
+
+#endif